@@ -0,0 +1,331 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "random.hpp"
+#include "recording.hpp"
+#include "scenarios.hpp"
+#include "snapshot.hpp"
+#include "sparse_world.hpp"
+#include "timer.hpp"
+#include "world.hpp"
+
+// Runs the canned scenarios headless and prints one JSON object per
+// scenario, so the results can be compared between builds by a script.
+// Every scenario runs in a process of its own where fork is available, so
+// its peak memory doesn't include the worlds of the scenarios before it.
+// The verify mode only applies to the dense scenarios, the sparse world
+// has no checkerboard to verify.
+//
+// Usage: crumble_bench [--scenario name] [--ticks n] [--seed n]
+//                      [--mode serial|parallel|verify] [--threads n]
+//                      [--width n] [--height n] [--save path]
+//                      [--load path] [--replay path] [--list]
+
+struct Options {
+    std::string scenario;           // Runs every scenario when empty.
+    int ticks           = 0;        // Uses the scenario's default when 0.
+    std::uint64_t seed  = 1;
+    UpdateMode mode     = UpdateMode::SERIAL;
+    int thread_count    = 0;
+    int width           = DEFAULT_WIDTH;
+    int height          = DEFAULT_HEIGHT;
+    std::string save_path;          // Saves a snapshot of the world after the setup.
+    std::string load_path;          // Loads a snapshot instead of running the setup.
+    std::string replay_path;        // Replays a recorded session instead of the scenarios.
+};
+
+// Returns the peak resident memory of the process in bytes. The peak
+// never goes down, so it covers every world the process simulated.
+static std::uint64_t get_peak_memory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;        // Bytes on macOS.
+#else
+    return usage.ru_maxrss * 1024; // Kilobytes on Linux.
+#endif
+#endif
+}
+
+// Steps the world and returns the number of cell updates. The step
+// function advances the world by a tick and returns its cell updates.
+template<typename Step>
+static std::uint64_t run_ticks(const int ticks, Step&& step, Timer& timer) {
+    std::uint64_t cell_updates = 0;
+    timer.start();
+    for(int i = 0; i < ticks; ++i)
+        cell_updates += step();
+    timer.stop();
+    return cell_updates;
+}
+
+// The names of the update modes on the command line and in the results.
+static const char* name_of(const UpdateMode mode) {
+    switch(mode) {
+        case UpdateMode::SERIAL:   return "serial";
+        case UpdateMode::PARALLEL: return "parallel";
+        case UpdateMode::VERIFY:   return "verify";
+    }
+    return "serial";
+}
+
+// Prints the results of a run as a JSON object. The size is a list of
+// JSON fields, which depends on the kind of world.
+static void print_result(const std::string& name, const Options& options, const std::uint64_t seed,
+                         const std::string& size, const double setup_seconds, const int ticks,
+                         const double seconds, const std::uint64_t cell_updates, const int particles) {
+    std::cout << "{\"scenario\": \""         << name << '"'
+              << ", \"mode\": \""            << name_of(options.mode) << '"'
+              << ", \"seed\": "              << seed
+              << size
+              << ", \"setup_seconds\": "     << setup_seconds
+              << ", \"ticks\": "             << ticks
+              << ", \"seconds\": "           << seconds
+              << ", \"ticks_per_second\": "  << ticks / seconds
+              << ", \"cell_updates\": "      << cell_updates
+              << ", \"cell_updates_per_second\": " << cell_updates / seconds
+              << ", \"particles\": "         << particles
+              << ", \"peak_memory_bytes\": " << get_peak_memory()
+              << "}" << std::endl;
+}
+
+// Replays the session tick for tick, as fast as possible.
+static bool run_replay(const Options& options) {
+    Recording recording;
+    Timer setup_timer, timer;
+
+    setup_timer.start();
+    if(!load_recording(options.replay_path, recording))
+        return false;
+    setup_timer.stop();
+
+    World world(recording.seed, options.thread_count, recording.width, recording.height);
+    world.get_simulation().set_update_mode(options.mode);
+    RecordingPlayer player(recording);
+    player.start();
+
+    const int ticks = int(recording.end_tick);
+    const std::uint64_t cell_updates = run_ticks(ticks, [&]() {
+        player.apply_commands(world);
+        world.step();
+        return world.get_simulation().get_updated_cell_count();
+    }, timer);
+
+    print_result("replay", options, recording.seed,
+                 ", \"width\": "  + std::to_string(world.get_width()) +
+                 ", \"height\": " + std::to_string(world.get_height()) +
+                 ", \"commands\": " + std::to_string(recording.commands.size()),
+                 setup_timer.get_prev_elapsed_time().count(), ticks,
+                 timer.get_prev_elapsed_time().count(), cell_updates, world.count());
+    return true;
+}
+
+static bool run(const Scenario& scenario, const Options& options) {
+    // The particles placed by the setup draw their colors
+    // on this thread, which has to start from the seed too.
+    seed_random(options.seed);
+
+    const int ticks = options.ticks > 0 ? options.ticks : scenario.ticks;
+    std::uint64_t cell_updates = 0;
+    std::uint64_t seed = options.seed;
+    int particles = 0;
+    Timer setup_timer, timer;
+    std::string size; // The size of the world as JSON fields.
+
+    if(scenario.sparse_setup) {
+        if(!options.save_path.empty() || !options.load_path.empty()) {
+            std::cerr << "Snapshots can't store the sparse world of " << scenario.name << '\n';
+            return false;
+        }
+        if(options.mode == UpdateMode::VERIFY) {
+            std::cerr << "The sparse world of " << scenario.name << " can't be verified\n";
+            return false;
+        }
+
+        SparseWorld world(options.seed, options.thread_count);
+        world.set_update_mode(options.mode);
+        setup_timer.start();
+        scenario.sparse_setup(world);
+        setup_timer.stop();
+
+        cell_updates = run_ticks(ticks, [&]() {
+            world.step();
+            return world.get_updated_cell_count();
+        }, timer);
+        particles = world.count();
+        size = ", \"chunks\": " + std::to_string(world.get_chunk_count());
+    }
+    else {
+        // A loaded world takes the size of the snapshot.
+        SnapshotInfo info;
+        info.width  = options.width;
+        info.height = options.height;
+        if(!options.load_path.empty() && !read_snapshot_info(options.load_path, info))
+            return false;
+
+        World world(options.seed, options.thread_count, info.width, info.height);
+        world.get_simulation().set_update_mode(options.mode);
+
+        setup_timer.start();
+        if(options.load_path.empty())
+            scenario.setup(world);
+        else if(!load_snapshot(world, options.load_path))
+            return false;
+        setup_timer.stop();
+
+        if(!options.save_path.empty() && !save_snapshot(world, options.save_path))
+            return false;
+        seed = world.get_simulation().get_seed();
+
+        cell_updates = run_ticks(ticks, [&]() {
+            world.step();
+            return world.get_simulation().get_updated_cell_count();
+        }, timer);
+        particles = world.count();
+        size = ", \"width\": "  + std::to_string(world.get_width()) +
+               ", \"height\": " + std::to_string(world.get_height());
+    }
+
+    print_result(scenario.name, options, seed, size, setup_timer.get_prev_elapsed_time().count(),
+                 ticks, timer.get_prev_elapsed_time().count(), cell_updates, particles);
+    return true;
+}
+
+// Runs the scenario in a child process, whose peak memory then only
+// covers the scenario. The scenario runs in this process when there's no
+// fork, where the peak includes the scenarios run before.
+static bool run_in_process(const Scenario& scenario, const Options& options) {
+#ifdef _WIN32
+    return run(scenario, options);
+#else
+    // The child would print the output buffered so far again.
+    std::cout.flush();
+    const pid_t child = fork();
+    if(child < 0)
+        return run(scenario, options);
+    if(child == 0) {
+        const bool is_successful = run(scenario, options);
+        std::cout.flush();
+        std::exit(is_successful ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status = 0;
+    return waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+#endif
+}
+
+static void print_usage() {
+    std::cerr << "Usage: crumble_bench [--scenario name] [--ticks n] [--seed n]\n"
+              << "                     [--mode serial|parallel|verify] [--threads n]\n"
+              << "                     [--width n] [--height n] [--save path]\n"
+              << "                     [--load path] [--replay path] [--list]\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+
+    for(int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value  = i + 1 < argc;
+
+        if(arg == "--list") {
+            for(const Scenario& scenario: get_scenarios())
+                std::cout << scenario.name << ": " << scenario.description << '\n';
+            return EXIT_SUCCESS;
+        }
+        else if(arg == "--scenario" && has_value) {
+            options.scenario = argv[++i];
+        }
+        else if(arg == "--ticks" && has_value) {
+            options.ticks = std::atoi(argv[++i]);
+        }
+        else if(arg == "--seed" && has_value) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if(arg == "--threads" && has_value) {
+            options.thread_count = std::atoi(argv[++i]);
+        }
+        else if(arg == "--width" && has_value) {
+            options.width = std::atoi(argv[++i]);
+        }
+        else if(arg == "--height" && has_value) {
+            options.height = std::atoi(argv[++i]);
+        }
+        else if(arg == "--save" && has_value) {
+            options.save_path = argv[++i];
+        }
+        else if(arg == "--load" && has_value) {
+            options.load_path = argv[++i];
+        }
+        else if(arg == "--replay" && has_value) {
+            options.replay_path = argv[++i];
+        }
+        else if(arg == "--mode" && has_value) {
+            const std::string mode = argv[++i];
+            if(mode == name_of(UpdateMode::SERIAL))
+                options.mode = UpdateMode::SERIAL;
+            else if(mode == name_of(UpdateMode::PARALLEL))
+                options.mode = UpdateMode::PARALLEL;
+            else if(mode == name_of(UpdateMode::VERIFY))
+                options.mode = UpdateMode::VERIFY;
+            else {
+                std::cerr << "Unknown mode: " << mode << '\n';
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        }
+        else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(options.width < 1 || options.height < 1) {
+        std::cerr << "The width and height must be at least 1\n";
+        return EXIT_FAILURE;
+    }
+
+    if(!options.replay_path.empty())
+        return run_replay(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // A snapshot holds a single world.
+    if((!options.save_path.empty() || !options.load_path.empty()) && options.scenario.empty()) {
+        std::cerr << "Saving or loading a snapshot needs a scenario\n";
+        return EXIT_FAILURE;
+    }
+
+    bool found_scenario = false;
+    for(const Scenario& scenario: get_scenarios()) {
+        if(options.scenario.empty() || options.scenario == scenario.name) {
+            found_scenario = true;
+
+            // Running every scenario verifies the dense ones only.
+            if(options.scenario.empty() && options.mode == UpdateMode::VERIFY && scenario.sparse_setup)
+                continue;
+            if(!run_in_process(scenario, options))
+                return EXIT_FAILURE;
+        }
+    }
+
+    if(!found_scenario) {
+        std::cerr << "Unknown scenario: " << options.scenario << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
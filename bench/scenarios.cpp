@@ -0,0 +1,82 @@
+#include "scenarios.hpp"
+#include "particle_types.hpp"
+
+// Fills the rectangle [x0, x1) x [y0, y1) with the material.
+static void fill(World& world, int x0, int y0, int x1, int y1, const MaterialId material) {
+    for(int y = y0; y < y1; ++y) {
+        for(int x = x0; x < x1; ++x)
+            world.insert(x, y, material);
+    }
+}
+
+// The whole upper half of the world collapses onto the empty lower half.
+static void setup_sand_avalanche(World& world) {
+    const int width = world.get_width(), height = world.get_height();
+    fill(world, 0, height / 2, width, height, ParticleType::SAND);
+}
+
+// A dam of water on the left breaks and disperses over the floor.
+static void setup_water_flood(World& world) {
+    const int width = world.get_width(), height = world.get_height();
+    fill(world, 0, 0, width / 3, height * 2 / 3, ParticleType::WATER);
+}
+
+// A full-width block of wood is lit along its left edge.
+static void setup_forest_fire(World& world) {
+    const int width = world.get_width(), height = world.get_height();
+    fill(world, 0, height / 8, width, height / 2, ParticleType::WOOD);
+
+    for(int y = height / 8; y < height / 2; ++y) {
+        world.remove(0, y);
+        world.insert(0, y, ParticleType::FIRE);
+    }
+}
+
+// Alternating layers of steam and smoke rise and pile up under a ceiling.
+static void setup_steam_and_smoke(World& world) {
+    const int width = world.get_width(), height = world.get_height();
+    fill(world, 0, height - 2, width, height, ParticleType::WALL);
+
+    for(int y = 0; y < height / 2; ++y) {
+        const MaterialId material = (y / 4) % 2 == 0 ? ParticleType::STEAM : ParticleType::SMOKE;
+        fill(world, width / 8, y, width - width / 8, y + 1, material);
+    }
+}
+
+// Small sand piles and pools of water on ledges, scattered over a world
+// 262144 cells across that would take hundreds of gigabytes to store
+// densely. The piles spill over the ledges and fall into basins below.
+static void setup_sparse_islands(SparseWorld& world) {
+    const int spacing = 32768, floor_y = -256;
+
+    for(int site_y = 0; site_y < 8; ++site_y) {
+        for(int site_x = 0; site_x < 8; ++site_x) {
+            const int x = site_x * spacing, y = site_y * spacing;
+
+            for(int i = -64; i < 128; ++i)
+                world.insert(x + i, y + floor_y, ParticleType::WALL);
+            for(int j = 1; j <= 32; ++j) {
+                world.insert(x - 64, y + floor_y + j, ParticleType::WALL);
+                world.insert(x + 127, y + floor_y + j, ParticleType::WALL);
+            }
+            for(int i = 0; i < 48; ++i)
+                world.insert(x + i, y, ParticleType::WALL);
+
+            for(int j = 1; j <= 64; ++j) {
+                for(int i = 0; i < 48; ++i)
+                    world.insert(x + i, y + j, j <= 16 ? ParticleType::WATER : ParticleType::SAND);
+            }
+        }
+    }
+}
+
+const std::vector<Scenario>& get_scenarios() {
+    static const std::vector<Scenario> scenarios = {
+        {"sand_avalanche",  "The upper half of the world is sand that falls",   600, setup_sand_avalanche},
+        {"water_flood",     "A block of water disperses across the floor",      600, setup_water_flood},
+        {"forest_fire",     "Fire spreads through a full-width block of wood",  900, setup_forest_fire},
+        {"steam_and_smoke", "Layers of steam and smoke rise under a ceiling",   600, setup_steam_and_smoke},
+        {"sparse_islands",  "Sand piles scattered over a huge sparse world",    600, nullptr, setup_sparse_islands},
+    };
+    return scenarios;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "sparse_world.hpp"
+#include "world.hpp"
+
+// A canned workload for the benchmark. The setup fills an empty world and
+// only depends on the world's seed, so every run simulates the same ticks.
+// Sparse scenarios set sparse_setup instead and run in a SparseWorld,
+// where the size options of the benchmark don't apply.
+struct Scenario {
+    std::string name;
+    std::string description;
+    int ticks;                          // The default number of ticks to run.
+    std::function<void(World&)> setup;
+    std::function<void(SparseWorld&)> sparse_setup = nullptr;
+};
+
+// Returns every scenario in the order they are run.
+const std::vector<Scenario>& get_scenarios();
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Bit manipulation used by the occupancy bitmap of the grid and by the SIMD
+// passes. The results are undefined when the word is 0, except for
+// count_set_bits.
+
+inline int count_trailing_zeros(const std::uint32_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, word);
+    return int(index);
+#else
+    return __builtin_ctz(word);
+#endif
+}
+
+inline int count_leading_zeros(const std::uint32_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, word);
+    return 31 - int(index);
+#else
+    return __builtin_clz(word);
+#endif
+}
+
+inline int count_set_bits(const std::uint32_t word) {
+#ifdef _MSC_VER
+    return int(__popcnt(word));
+#else
+    return __builtin_popcount(word);
+#endif
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "brush.hpp"
+
+// The cells a brush covers in one of its rows, relative to the cell the
+// brush is stamped on.
+struct BrushSpan {
+    int min_x, max_x;
+};
+
+// Returns the span of every row of the brush, from the row of the cell
+// downwards. The top-left corner of a square brush is the cell, which
+// matches where the cursor points.
+static std::vector<BrushSpan> get_spans(const BrushCommand& command) {
+    std::vector<BrushSpan> spans(command.size, BrushSpan{0, command.size - 1});
+    if(command.shape != BrushShape::CIRCLE)
+        return spans;
+
+    // The circle is centered within the square, distances are doubled to
+    // stay in integers. Every row of it holds a cell of the middle column.
+    const int radius = command.size;
+    for(int row = 0; row < command.size; ++row) {
+        const int dy = command.size - 1 - 2 * row;
+        int min_x = 0;
+        for(int dx = 1 - command.size; dx < 0 && dx * dx + dy * dy > radius * radius; dx += 2)
+            ++min_x;
+        spans[row] = BrushSpan{min_x, command.size - 1 - min_x};
+    }
+    return spans;
+}
+
+// Fills the empty cells of the row from min_x to max_x within the grid.
+static void fill_row(const BrushCommand& command, const int min_x, const int max_x, const int y, Grid& grid) {
+    for(int x = std::max(min_x, 0); x <= std::min(max_x, grid.get_width() - 1); ++x) {
+        if(grid.is_cell_empty(x, y))
+            grid.insert(x, y, command.material);
+    }
+}
+
+// Fills the empty cells covered by the brush at (x, y) that the brush at
+// the previous cell of the stroke didn't cover, which is every cell for
+// the first one. Each step of a stroke then only visits the edges of the
+// brush, instead of all of its cells again.
+static void stamp(const BrushCommand& command, const std::vector<BrushSpan>& spans, const int x, const int y,
+                  const bool has_previous, const int previous_x, const int previous_y, Grid& grid) {
+    const int size = command.size;
+    if(x + size - 1 < 0 || x >= grid.get_width() || y < 0 || y - size + 1 >= grid.get_height())
+        return;
+
+    for(int j = std::max(y - size + 1, 0); j <= std::min(y, grid.get_height() - 1); ++j) {
+        const int min_x = x + spans[y - j].min_x, max_x = x + spans[y - j].max_x;
+        const int previous_row = previous_y - j;
+
+        if(!has_previous || previous_row < 0 || previous_row >= size) {
+            fill_row(command, min_x, max_x, j, grid);
+            continue;
+        }
+
+        // The brush moves by a cell at most, so the rows overlap and only
+        // their ends are new.
+        const int covered_min_x = previous_x + spans[previous_row].min_x;
+        const int covered_max_x = previous_x + spans[previous_row].max_x;
+        if(covered_max_x < min_x || covered_min_x > max_x) {
+            fill_row(command, min_x, max_x, j, grid);
+            continue;
+        }
+        fill_row(command, min_x, covered_min_x - 1, j, grid);
+        fill_row(command, covered_max_x + 1, max_x, j, grid);
+    }
+}
+
+void apply_brush_command(const BrushCommand& command, Grid& grid) {
+    if(command.kind == BrushKind::CLEAR) {
+        grid.clear();
+        return;
+    }
+    const std::vector<BrushSpan> spans = get_spans(command);
+
+    // Bresenham's line algorithm visits every cell between the ends.
+    int x = command.x0, y = command.y0;
+    int previous_x = x, previous_y = y;
+    bool has_previous = false;
+    const int dx =  std::abs(command.x1 - command.x0), step_x = command.x0 < command.x1 ? 1 : -1;
+    const int dy = -std::abs(command.y1 - command.y0), step_y = command.y0 < command.y1 ? 1 : -1;
+    int error = dx + dy;
+
+    while(true) {
+        stamp(command, spans, x, y, has_previous, previous_x, previous_y, grid);
+        if(x == command.x1 && y == command.y1)
+            break;
+
+        previous_x   = x;
+        previous_y   = y;
+        has_previous = true;
+
+        const int doubled_error = 2 * error;
+        if(doubled_error >= dy) {
+            error += dy;
+            x     += step_x;
+        }
+        if(doubled_error <= dx) {
+            error += dx;
+            y     += step_y;
+        }
+    }
+}
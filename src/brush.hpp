@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+#include "grid.hpp"
+
+enum class BrushKind: std::uint8_t {
+    PAINT = 0, // Fills the empty cells along the stroke with the material.
+    CLEAR = 1  // Empties every cell of the grid.
+};
+
+enum class BrushShape: std::uint8_t {
+    SQUARE = 0,
+    CIRCLE = 1
+};
+
+// A change to the grid requested by the user. A stroke is the segment from
+// (x0, y0) to (x1, y1), and the brush is stamped on every cell along it so
+// fast movements leave continuous lines. A single click is a segment whose
+// ends are the same cell.
+struct BrushCommand {
+    BrushKind  kind     = BrushKind::PAINT;
+    BrushShape shape    = BrushShape::SQUARE;
+    MaterialId material = 0;
+    int size            = 1; // The width of the brush in cells.
+    int x0 = 0, y0 = 0;
+    int x1 = 0, y1 = 0;
+};
+
+// The largest brush, and the farthest from the origin the ends of a stroke
+// can be, which keep the distances of the circle brush within an int.
+inline const int MAX_BRUSH_SIZE       = 1024;
+inline const int MAX_BRUSH_COORDINATE = 1 << 24;
+
+// Applies the command to the grid. The cells outside the grid are skipped.
+void apply_brush_command(const BrushCommand& command, Grid& grid);
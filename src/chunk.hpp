@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
+// The width and height of a chunk in cells.
+inline const int CHUNK_SIZE = 32;
+
+// An inclusive rectangle of cells, which is empty when min > max.
+struct DirtyRect {
+public:
+    bool is_empty() const {
+        return min_x > max_x || min_y > max_y;
+    }
+
+    bool operator==(const DirtyRect& other) const {
+        return min_x == other.min_x && min_y == other.min_y &&
+               max_x == other.max_x && max_y == other.max_y;
+    }
+
+    // Grows the rectangle so it contains the rectangle specified.
+    void expand(const int x0, const int y0, const int x1, const int y1) {
+        min_x = std::min(min_x, x0);
+        min_y = std::min(min_y, y0);
+        max_x = std::max(max_x, x1);
+        max_y = std::max(max_y, y1);
+    }
+    void expand(const DirtyRect& other) {
+        expand(other.min_x, other.min_y, other.max_x, other.max_y);
+    }
+
+public:
+    int min_x = INT_MAX, min_y = INT_MAX;
+    int max_x = INT_MIN, max_y = INT_MIN;
+};
+
+// A DirtyRect that several threads can grow at the same time, which
+// happens when chunks updated in parallel wake a shared neighbor.
+struct AtomicDirtyRect {
+public:
+    AtomicDirtyRect() = default;
+
+    // Copying is not atomic, it is only meant for setting up the chunks.
+    AtomicDirtyRect(const AtomicDirtyRect& other) {
+        store(other.load());
+    }
+    AtomicDirtyRect& operator=(const AtomicDirtyRect& other) {
+        store(other.load());
+        return *this;
+    }
+
+    void expand(const int x0, const int y0, const int x1, const int y1) {
+        fetch_min(min_x, x0);
+        fetch_min(min_y, y0);
+        fetch_max(max_x, x1);
+        fetch_max(max_y, y1);
+    }
+
+    DirtyRect load() const {
+        DirtyRect rect;
+        rect.min_x = min_x.load(std::memory_order_relaxed);
+        rect.min_y = min_y.load(std::memory_order_relaxed);
+        rect.max_x = max_x.load(std::memory_order_relaxed);
+        rect.max_y = max_y.load(std::memory_order_relaxed);
+        return rect;
+    }
+
+    void store(const DirtyRect& rect) {
+        min_x.store(rect.min_x, std::memory_order_relaxed);
+        min_y.store(rect.min_y, std::memory_order_relaxed);
+        max_x.store(rect.max_x, std::memory_order_relaxed);
+        max_y.store(rect.max_y, std::memory_order_relaxed);
+    }
+
+private:
+    // Most calls don't grow the rectangle, so the
+    // value is checked before attempting to write.
+    static void fetch_min(std::atomic<int>& value, const int other) {
+        int current = value.load(std::memory_order_relaxed);
+        while(other < current && !value.compare_exchange_weak(current, other, std::memory_order_relaxed)) {
+        }
+    }
+    static void fetch_max(std::atomic<int>& value, const int other) {
+        int current = value.load(std::memory_order_relaxed);
+        while(other > current && !value.compare_exchange_weak(current, other, std::memory_order_relaxed)) {
+        }
+    }
+
+private:
+    std::atomic<int> min_x{INT_MAX}, min_y{INT_MAX};
+    std::atomic<int> max_x{INT_MIN}, max_y{INT_MIN};
+};
+
+// A fixed-size square region of the grid. Only the cells inside the dirty
+// rect of a chunk are simulated. The rect grows when a cell of the chunk
+// changes and shrinks back to nothing once the chunk has settled, which
+// lets static regions of the world sleep.
+struct Chunk {
+public:
+    Chunk(int x, int y): x(x), y(y) {}
+
+    bool is_awake() const {
+        return !rect.is_empty();
+    }
+
+    // The cells that changed during the previous tick are the
+    // cells that need to be simulated during the current tick.
+    void update_rect() {
+        rect = next_rect.load();
+        next_rect.store(DirtyRect());
+    }
+
+    // The cells that changed since the start of the previous tick. When it
+    // is read once per tick it covers every change, both the ones made by
+    // the tick and the ones made before it, like the cells a brush filled.
+    DirtyRect get_changed_rect() const {
+        DirtyRect changed = rect;
+        changed.expand(next_rect.load());
+        return changed;
+    }
+
+    // Chunks in the same phase of the checkerboard are never neighbors,
+    // so all the chunks of one phase can be updated at the same time.
+    int get_phase() const {
+        return ((x / CHUNK_SIZE) & 1) + 2 * ((y / CHUNK_SIZE) & 1);
+    }
+
+public:
+    int x, y;                  // The cell at the bottom-left corner of the chunk.
+    DirtyRect rect;            // The cells simulated during the current tick.
+    AtomicDirtyRect next_rect; // The cells that changed during the current tick.
+};
@@ -2,6 +2,7 @@
 #include <OpenGL/OpenGL.h>
 
 #include "gl_objects.hpp"
+#include "particle.hpp"
 
 // Constructor
 Square::Square() {
@@ -73,3 +74,18 @@ Point::Point() {
 Point::~Point() {
     glDeleteVertexArrays(1, &VAO);
 }
+
+PaletteTexture::PaletteTexture() {
+    // The palette never changes, it is uploaded once.
+    glGenTextures(1, &ID);
+    glBindTexture(GL_TEXTURE_2D, ID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, PALETTE_SIZE, 1, 0,
+                 GL_RGB, GL_FLOAT, get_palette().data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+PaletteTexture::~PaletteTexture() {
+    glDeleteTextures(1, &ID);
+}
@@ -18,3 +18,13 @@ public:
 public:
     unsigned int VBO, VAO;
 };
+
+// A row of 256 colors, the color of every palette index.
+struct PaletteTexture {
+public:
+    PaletteTexture();
+    ~PaletteTexture();
+
+public:
+    unsigned int ID;
+};
@@ -4,10 +4,7 @@
 #include <glad/glad.h>
 
 #include "glfw_wrapper.hpp"
-
-extern std::thread G_WORKER_THREAD;
-extern bool        G_DO_WORK_IN_THREAD;
-extern bool        G_KEEP_THREAD_RUNNING;
+#include "particle_system.hpp"
 
 GlfwWrapper::GlfwWrapper(const int width, const int height, const char* title) {
         glfwInit();
@@ -52,12 +49,15 @@ void GlfwWrapper::set_callbacks() {
     glfwSetFramebufferSizeCallback(m_window, [](GLFWwindow* window, int width, int height) {
         glViewport(0, 0, width, height);
     });
+    // These are installed before ImGui's, which forwards the events to them.
     glfwSetMouseButtonCallback(m_window, [](GLFWwindow* window, int button, int action, int mods) {
-        if(button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-            G_DO_WORK_IN_THREAD = true;
-        }
-        else if(button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
-            G_DO_WORK_IN_THREAD = false;
-        }
+        auto* particle_system = static_cast<ParticleSystem*>(glfwGetWindowUserPointer(window));
+        if(particle_system != nullptr)
+            particle_system->on_mouse_button(window, button, action);
+    });
+    glfwSetCursorPosCallback(m_window, [](GLFWwindow* window, double xpos, double ypos) {
+        auto* particle_system = static_cast<ParticleSystem*>(glfwGetWindowUserPointer(window));
+        if(particle_system != nullptr)
+            particle_system->on_cursor_pos(window, xpos, ypos);
     });
 }
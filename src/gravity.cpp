@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "bits.hpp"
+#include "gravity.hpp"
+#include "material.hpp"
+#include "particle_types.hpp"
+
+static bool can_fall(const MaterialRegistry& registry, const MaterialId material, const MaterialId material_below) {
+    return registry.falls(material) && material_below == ParticleType::EMPTY;
+}
+
+int apply_gravity_to_row(Grid& grid, const int y, const int min_x, const int max_x) {
+    const MaterialRegistry& registry = material_registry();
+    const std::vector<MaterialId>& falling_materials = registry.get_falling_materials();
+    const MaterialId* row   = grid.materials_of_row(y);
+    const MaterialId* below = grid.materials_of_row(y - 1);
+
+    int moved_count = 0;
+    int first_moved = INT_MAX, last_moved = INT_MIN;
+
+    // Particles that already moved this tick, like the ones
+    // pushed into the row by a neighboring chunk, stay put.
+    auto drop = [&](const int x) {
+        if(grid.mark_updated(x, y)) {
+            grid.drop(x, y);
+            first_moved = std::min(first_moved, x);
+            last_moved  = std::max(last_moved, x);
+            ++moved_count;
+        }
+    };
+
+    // Only the column of a particle changes when it falls, so
+    // the materials that were loaded stay valid for the rest.
+    int x = min_x;
+
+#if defined(__AVX2__)
+    const __m256i empty_32 = _mm256_set1_epi8(char(ParticleType::EMPTY));
+
+    for(; x + 32 <= max_x + 1; x += 32) {
+        const __m256i materials       = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+        const __m256i materials_below = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x));
+
+        __m256i falls = _mm256_setzero_si256();
+        for(const MaterialId material: falling_materials)
+            falls = _mm256_or_si256(falls, _mm256_cmpeq_epi8(materials, _mm256_set1_epi8(char(material))));
+        const __m256i empty = _mm256_cmpeq_epi8(materials_below, empty_32);
+
+        std::uint32_t mask = std::uint32_t(_mm256_movemask_epi8(_mm256_and_si256(falls, empty)));
+        for(; mask != 0; mask &= mask - 1)
+            drop(x + count_trailing_zeros(mask));
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i empty_16 = _mm_set1_epi8(char(ParticleType::EMPTY));
+
+    for(; x + 16 <= max_x + 1; x += 16) {
+        const __m128i materials       = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        const __m128i materials_below = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x));
+
+        __m128i falls = _mm_setzero_si128();
+        for(const MaterialId material: falling_materials)
+            falls = _mm_or_si128(falls, _mm_cmpeq_epi8(materials, _mm_set1_epi8(char(material))));
+        const __m128i empty = _mm_cmpeq_epi8(materials_below, empty_16);
+
+        std::uint32_t mask = std::uint32_t(_mm_movemask_epi8(_mm_and_si128(falls, empty)));
+        for(; mask != 0; mask &= mask - 1)
+            drop(x + count_trailing_zeros(mask));
+    }
+#endif
+
+    for(; x <= max_x; ++x) {
+        if(can_fall(registry, row[x], below[x]))
+            drop(x);
+    }
+
+    if(moved_count > 0)
+        grid.keep_awake(first_moved, y - 1, last_moved, y);
+    return moved_count;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "grid.hpp"
+
+// Moves the powders and liquids between min_x and max_x of the row down by one
+// cell when the cell below is empty, and marks them as updated. This is
+// the most common move of large pours and avalanches, and the particles
+// that can fall are found by comparing whole rows of materials at once
+// with each material that falls.
+// Depending on what the compiler targets, this uses AVX2, SSE2 or plain
+// C++. Returns the number of particles that moved.
+int apply_gravity_to_row(Grid& grid, const int y, const int min_x, const int max_x);
@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <csignal>
 #include <iostream>
 
+#include "bits.hpp"
 #include "grid.hpp"
 #include "particle.hpp"
+#include "particle_types.hpp"
+#include "random.hpp"
 
 Cell Cell::left() const {
     return Cell(x - 1, y);
@@ -29,22 +33,46 @@ Cell Cell::down_left() const {
     return Cell(x - 1, y - 1);
 }
 
-Grid::Grid() {
-    for(int i = 0; i < ROWS; ++i) {
-        for(int j = 0; j < COLUMNS; ++j) {
-            grid[i][j] = NULL;
+bool GridState::operator==(const GridState& other) const {
+    return materials == other.materials && lifetimes == other.lifetimes &&
+           ignition_delays == other.ignition_delays && update_stamps == other.update_stamps &&
+           color_seeds == other.color_seeds &&
+           rects == other.rects && next_rects == other.next_rects && timers == other.timers;
+}
+
+Grid::Grid(const int width, const int height)
+    : width_(width), height_(height),
+      stride_(width + 2 * BORDER_SIZE), padded_height_(height + 2 * BORDER_SIZE),
+      materials_(std::size_t(stride_) * padded_height_, ParticleType::EMPTY),
+      lifetimes_(std::size_t(stride_) * padded_height_, 0),
+      ignition_delays_(std::size_t(stride_) * padded_height_, 0),
+      update_stamps_(std::size_t(stride_) * padded_height_, std::uint16_t(-1)),
+      color_seeds_(std::size_t(stride_) * padded_height_, 0),
+      chunk_columns_((width + CHUNK_SIZE - 1) / CHUNK_SIZE),
+      chunk_rows_((height + CHUNK_SIZE - 1) / CHUNK_SIZE),
+      occupancy_words_((OCCUPANCY_OFFSET + width + BORDER_SIZE + OCCUPANCY_BITS - 1) / OCCUPANCY_BITS),
+      occupancy_(std::size_t(occupancy_words_) * padded_height_) {
+    assert(width > 0 && height > 0);
+    chunks_.reserve(chunk_columns_ * chunk_rows_);
+
+    for(int y = 0; y < chunk_rows_; ++y) {
+        for(int x = 0; x < chunk_columns_; ++x) {
+            chunks_.emplace_back(x * CHUNK_SIZE, y * CHUNK_SIZE);
         }
     }
+    chunk_populations_ = std::vector<std::atomic<int>>(chunks_.size());
+    timers_.resize(chunks_.size());
+    leveling_requests_.resize(chunks_.size());
+    fill_border();
+    recount_population();
 }
 
-Grid::~Grid() {
-    clear();
-}
+Grid::~Grid() = default;
 
-Particle* & Grid::at(const int i, const int j) {
+MaterialId Grid::at(const int i, const int j) const {
     try{
-        if((i >= 0 && j >= 0) && (i < ROWS && j < COLUMNS)) {
-            return grid[i][j];
+        if((i >= 0 && j >= 0) && (i < width_ && j < height_)) {
+            return materials_[index_of(i, j)];
         }
         else {
             throw -1;
@@ -56,24 +84,15 @@ Particle* & Grid::at(const int i, const int j) {
     }
 }
 
-Particle* & Grid::at(const Cell cell) {
-    try{
-        if((cell.x >= 0 && cell.y >= 0) && (cell.x < ROWS && cell.y < COLUMNS)) {
-            return grid[cell.x][cell.y];
-        }
-        else {
-            throw -1;
-        }
-    }
-    catch(int error) {
-        std::cerr << "Index out of bounds: " << cell.x << ' ' << cell.y << '\n';
-        throw error;
-    }
+MaterialId Grid::at(const Cell cell) const {
+    return at(cell.x, cell.y);
 }
 
-void Grid::insert(const int x, const int y, Particle* particle) {
-    if(is_within_bounds(x, y) && is_cell_empty(x, y))
-        grid[x][y] = particle;
+void Grid::insert(const int x, const int y, const MaterialId material) {
+    if(is_within_bounds(x, y) && is_cell_empty(x, y)) {
+        set_cell(x, y, material);
+        keep_awake(Cell(x, y));
+    }
     /*
     else if(!is_cell_empty(x, y))
         std::cerr << "Warn: insert called when the cell is not empty: " 
@@ -81,134 +100,465 @@ void Grid::insert(const int x, const int y, Particle* particle) {
     */
 }
 
-void Grid::insert(const Cell cell, Particle* particle) {
-    if(is_within_bounds(cell.x, cell.y) && is_cell_empty(cell.x, cell.y))
-        grid[cell.x][cell.y] = particle;
-    /*
-    else if(!is_cell_empty(cell.x, cell.y))
-        std::cerr << "Warn: insert called when the cell is not empty: " 
-                  << cell.x << ' ' << cell.y << '\n';
-    */
+void Grid::insert(const Cell cell, const MaterialId material) {
+    insert(cell.x, cell.y, material);
 }
 
 void Grid::remove(const int x, const int y) {
-    if(is_within_bounds(x, y) && !is_cell_empty(x, y)) {
-        delete grid[x][y];
-        grid[x][y] = NULL;
-    }
-    else if(!is_cell_empty(x, y))
-        std::cerr << "Warn: remove called when the cell is empty: " 
+    // The cells are only read within the grid, the border is too
+    // thin for the cells far outside of it.
+    if(!is_within_bounds(x, y)) {
+        std::cerr << "Warn: remove called outside of the grid: "
                   << x << ' ' << y << '\n';
+    }
+    else if(!is_cell_empty(x, y)) {
+        set_cell(x, y, ParticleType::EMPTY);
+        keep_awake(Cell(x, y));
+    }
+}
+
+void Grid::convert(const Cell cell, const MaterialId material) {
+    if(is_within_bounds(cell.x, cell.y)) {
+        set_cell(cell.x, cell.y, material);
+        keep_awake(cell);
+    }
 }
 
 int Grid::count() const {
-    int count = 0;
+    return width_ * height_ - count_of(ParticleType::EMPTY);
+}
 
-    for(int i = 0; i < ROWS; ++i) {
-        for(int j = 0; j < COLUMNS; ++j) {
-            if(grid[i][j] != NULL)
-                count++;
+template<typename Function>
+void Grid::for_each_occupancy_word(const int min_x, const int min_y,
+                                   const int max_x, const int max_y, Function&& function) const {
+    assert(min_x >= 0 && min_y >= 0 && max_x < width_ && max_y < height_);
+    const int first_word = (min_x + OCCUPANCY_OFFSET) / OCCUPANCY_BITS;
+    const int last_word  = (max_x + OCCUPANCY_OFFSET) / OCCUPANCY_BITS;
+    const std::uint32_t first_mask = ~std::uint32_t(0) << occupancy_bit_of(min_x);
+    const std::uint32_t last_mask  = ~std::uint32_t(0) >> (OCCUPANCY_BITS - 1 - occupancy_bit_of(max_x));
+
+    for(int y = min_y; y <= max_y; ++y) {
+        const std::size_t row = std::size_t(y + BORDER_SIZE) * occupancy_words_;
+        for(int i = first_word; i <= last_word; ++i) {
+            std::uint32_t word = occupancy_[row + i];
+            if(i == first_word)
+                word &= first_mask;
+            if(i == last_word)
+                word &= last_mask;
+            if(!function(word))
+                return;
         }
     }
-    return count;
 }
 
-bool Grid::is_cell_empty(const int i, const int j) const {
-    if(grid[i][j] == NULL) {
+int Grid::count_in_region(const int min_x, const int min_y, const int max_x, const int max_y) const {
+    int count = 0;
+    for_each_occupancy_word(min_x, min_y, max_x, max_y, [&](const std::uint32_t word) {
+        count += count_set_bits(word);
         return true;
+    });
+    return count;
+}
+
+bool Grid::is_region_empty(const int min_x, const int min_y, const int max_x, const int max_y) const {
+    bool is_empty = true;
+    for_each_occupancy_word(min_x, min_y, max_x, max_y, [&](const std::uint32_t word) {
+        is_empty = word == 0;
+        return is_empty;
+    });
+    return is_empty;
+}
+
+int Grid::next_occupied_x(const int x, const int y, const int max_x) const {
+    const std::size_t row = std::size_t(y + BORDER_SIZE) * occupancy_words_;
+    const int last_bit = max_x + OCCUPANCY_OFFSET;
+    int bit = x + OCCUPANCY_OFFSET;
+
+    // The words past max_x aren't loaded, another chunk might be changing them.
+    while(bit <= last_bit) {
+        const std::uint32_t word = occupancy_[row + bit / OCCUPANCY_BITS] >> (bit % OCCUPANCY_BITS);
+        if(word != 0)
+            return std::min(bit + count_trailing_zeros(word), last_bit + 1) - OCCUPANCY_OFFSET;
+        bit += OCCUPANCY_BITS - bit % OCCUPANCY_BITS;
     }
-    return false;
+    return max_x + 1;
 }
 
-bool Grid::is_cell_empty(Cell cell) {
-    if(grid[cell.x][cell.y] == NULL) {
-        return true;
+int Grid::count_empty_left_of(const Cell cell, const int limit) const {
+    const std::size_t row = std::size_t(cell.y + BORDER_SIZE) * occupancy_words_;
+    int position = cell.x + OCCUPANCY_OFFSET - 1;
+    int count = 0;
+
+    // The bit of the cell is moved to the top of the word, the leading
+    // zeros are the empty cells. The border on the left ends the scan.
+    while(count < limit) {
+        const int bit = position % OCCUPANCY_BITS;
+        const std::uint32_t word = occupancy_[row + position / OCCUPANCY_BITS] << (OCCUPANCY_BITS - 1 - bit);
+        const int empty_count = word != 0 ? count_leading_zeros(word) : bit + 1;
+        count += empty_count;
+        if(empty_count <= bit)
+            break;
+        position -= bit + 1;
+    }
+    return std::min(count, limit);
+}
+
+int Grid::count_empty_right_of(const Cell cell, const int limit) const {
+    const std::size_t row = std::size_t(cell.y + BORDER_SIZE) * occupancy_words_;
+    int position = cell.x + OCCUPANCY_OFFSET + 1;
+    int count = 0;
+
+    // The trailing zeros are the empty cells. The border on the right
+    // ends the scan.
+    while(count < limit) {
+        const int bit = position % OCCUPANCY_BITS;
+        const std::uint32_t word = occupancy_[row + position / OCCUPANCY_BITS] >> bit;
+        const int empty_count = word != 0 ? count_trailing_zeros(word) : OCCUPANCY_BITS - bit;
+        count += empty_count;
+        if(empty_count < OCCUPANCY_BITS - bit)
+            break;
+        position += OCCUPANCY_BITS - bit;
     }
-    return false;
+    return std::min(count, limit);
 }
 
 void Grid::swap(const int i1, const int j1, const int i2, const int j2) {
-    Particle* temp = this->at(i2, j2);
-    this->at(i2, j2) = this->at(i1, j1);
-    this->at(i1, j1) = temp;
+    assert(i1 >= 0 && j1 >= 0 && i1 < width_ && j1 < height_);
+    assert(i2 >= 0 && j2 >= 0 && i2 < width_ && j2 < height_);
+
+    const std::size_t first = index_of(i1, j1), second = index_of(i2, j2);
+    swap_cells(first, second);
+
+    // A particle moved into another chunk when only one of the cells is empty.
+    const bool is_first_empty = materials_[first] == ParticleType::EMPTY;
+    if(is_first_empty != (materials_[second] == ParticleType::EMPTY)) {
+        const int first_chunk = chunk_index_of(i1, j1), second_chunk = chunk_index_of(i2, j2);
+        if(first_chunk != second_chunk) {
+            chunk_populations_[is_first_empty ? first_chunk : second_chunk].fetch_sub(1, std::memory_order_relaxed);
+            chunk_populations_[is_first_empty ? second_chunk : first_chunk].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    keep_awake(Cell(i1, j1));
+    keep_awake(Cell(i2, j2));
+}
+
+void Grid::drop(const int x, const int y) {
+    assert(x >= 0 && y > 0 && x < width_ && y < height_);
+    swap_cells(index_of(x, y), index_of(x, y - 1));
+
+    // The particle left the chunk from its bottom row.
+    if(y % CHUNK_SIZE == 0) {
+        chunk_populations_[chunk_index_of(x, y)].fetch_sub(1, std::memory_order_relaxed);
+        chunk_populations_[chunk_index_of(x, y - 1)].fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 void Grid::swap(const Cell cell1, const Cell cell2) {
-    Particle* temp = this->at(cell2.x, cell2.y);
-    this->at(cell2.x, cell2.y) = this->at(cell1.x, cell1.y);
-    this->at(cell1.x, cell1.y) = temp;
+    swap(cell1.x, cell1.y, cell2.x, cell2.y);
 }
 
 void Grid::move_cell_left_until_blocked(Cell cell, int times) {
-    Cell furthest_empty_cell = cell;
+    const int distance = count_empty_left_of(cell, times);
+    if(distance > 0)
+        swap(cell, Cell(cell.x - distance, cell.y));
+}
 
-    for(int i = 1; i <= times; ++i) {
-        if(!is_cell_empty(cell.x - i, cell.y)) {
-            break;
+void Grid::move_cell_right_until_blocked(Cell cell, int times) {
+    const int distance = count_empty_right_of(cell, times);
+    if(distance > 0)
+        swap(cell, Cell(cell.x + distance, cell.y));
+}
+
+void Grid::clear() {
+    std::fill(materials_.begin(), materials_.end(), ParticleType::EMPTY);
+    std::fill(lifetimes_.begin(), lifetimes_.end(), 0);
+    std::fill(ignition_delays_.begin(), ignition_delays_.end(), 0);
+    std::fill(update_stamps_.begin(), update_stamps_.end(), std::uint16_t(update_stamp_ - 1));
+    std::fill(color_seeds_.begin(), color_seeds_.end(), 0);
+    fill_border();
+    recount_population();
+
+    for(std::map<std::uint64_t, DirtyRect>& timers: timers_)
+        timers.clear();
+    for(std::vector<Cell>& requests: leveling_requests_)
+        requests.clear();
+
+    // Every cell changed, which the renderers need to know. The chunks
+    // wake up for a single tick and fall asleep again since they're empty.
+    for(Chunk& chunk: chunks_) {
+        DirtyRect all;
+        all.expand(chunk.x, chunk.y,
+                   std::min(chunk.x + CHUNK_SIZE, width_) - 1,
+                   std::min(chunk.y + CHUNK_SIZE, height_) - 1);
+        chunk.rect = DirtyRect();
+        chunk.next_rect.store(all);
+    }
+}
+
+void Grid::keep_awake(const Cell cell) {
+    keep_awake(cell.x, cell.y, cell.x, cell.y);
+}
+
+void Grid::keep_awake(const int x0, const int y0, const int x1, const int y1) {
+    // The neighbors are included since they might be able
+    // to move now, like sand above a cell that was emptied.
+    const int min_x = std::max(x0 - 1, 0);
+    const int min_y = std::max(y0 - 1, 0);
+    const int max_x = std::min(x1 + 1, width_ - 1);
+    const int max_y = std::min(y1 + 1, height_ - 1);
+
+    // The neighbors of a single cell belong to at most four chunks.
+    for(int y = min_y / CHUNK_SIZE; y <= max_y / CHUNK_SIZE; ++y) {
+        for(int x = min_x / CHUNK_SIZE; x <= max_x / CHUNK_SIZE; ++x) {
+            Chunk& chunk = chunks_[y * chunk_columns_ + x];
+            chunk.next_rect.expand(std::max(min_x, chunk.x),
+                                   std::max(min_y, chunk.y),
+                                   std::min(max_x, chunk.x + CHUNK_SIZE - 1),
+                                   std::min(max_y, chunk.y + CHUNK_SIZE - 1));
         }
-        else if(is_cell_empty(cell.x - i, cell.y)) {
-            furthest_empty_cell.x = cell.x - i;
+    }
+}
+
+void Grid::wake_at(const Cell cell, const std::uint64_t tick) {
+    const std::uint64_t due_tick = std::max(tick, tick_ + 1);
+    timers_[chunk_index_of(cell.x, cell.y)][due_tick].expand(cell.x, cell.y, cell.x, cell.y);
+}
+
+void Grid::wake_due_cells() {
+    for(int i = 0; i < int(chunks_.size()); ++i) {
+        std::map<std::uint64_t, DirtyRect>& timers = timers_[i];
+        while(!timers.empty() && timers.begin()->first <= tick_) {
+            const DirtyRect& rect = timers.begin()->second;
+            chunks_[i].next_rect.expand(rect.min_x, rect.min_y, rect.max_x, rect.max_y);
+            timers.erase(timers.begin());
         }
     }
+}
+
+void Grid::copy_chunk_to(const int chunk_index, ChunkCells& cells) const {
+    const Chunk& chunk = chunks_[chunk_index];
+    const int width  = std::min(CHUNK_SIZE, width_ - chunk.x);
+    const int height = std::min(CHUNK_SIZE, height_ - chunk.y);
+
+    if(width < CHUNK_SIZE || height < CHUNK_SIZE) {
+        cells.materials.fill(ParticleType::EMPTY);
+        cells.lifetimes.fill(0);
+        cells.ignition_delays.fill(0);
+        cells.color_seeds.fill(0);
+    }
 
-    if(furthest_empty_cell.x != cell.x) {
-        swap(cell, furthest_empty_cell);
+    for(int y = 0; y < height; ++y) {
+        const std::size_t row = index_of(chunk.x, chunk.y + y);
+        std::copy_n(&materials_[row],       width, &cells.materials[y * CHUNK_SIZE]);
+        std::copy_n(&lifetimes_[row],       width, &cells.lifetimes[y * CHUNK_SIZE]);
+        std::copy_n(&ignition_delays_[row], width, &cells.ignition_delays[y * CHUNK_SIZE]);
+        std::copy_n(&color_seeds_[row],     width, &cells.color_seeds[y * CHUNK_SIZE]);
     }
+
+    // The timers sorted by tick are a heap with the earliest tick first.
+    cells.timers.clear();
+    for(const auto& timer: timers_[chunk_index])
+        cells.timers.push_back(CellTimer{timer.first, timer.second}.translated(-chunk.x, -chunk.y));
 }
 
-void Grid::move_cell_right_until_blocked(Cell cell, int times) {
-    Cell furthest_empty_cell = cell;
+void Grid::copy_chunk_from(const int chunk_index, const ChunkCells& cells) {
+    copy_chunks_from(chunk_index, 1, &cells);
+}
 
-    for(int i = 1; i <= times; ++i) {
-        if(!is_cell_empty(cell.x + i, cell.y)) {
-            break;
-        }
-        else if(is_cell_empty(cell.x + i, cell.y)) {
-            furthest_empty_cell.x = cell.x + i;
+void Grid::copy_chunks_from(const int first_chunk_index, const int chunk_count, const ChunkCells* cells) {
+    const Chunk& first_chunk = chunks_[first_chunk_index];
+    const int height = std::min(CHUNK_SIZE, height_ - first_chunk.y);
+    assert(first_chunk_index % chunk_columns_ + chunk_count <= chunk_columns_);
+
+    // The counts are updated once at the end, since loading a
+    // snapshot copies every chunk and most of the cells change.
+    std::array<int, 256> count_changes = {};
+    std::vector<int> population_changes(chunk_count, 0);
+
+    for(int y = 0; y < height; ++y) {
+        const int cell_y = first_chunk.y + y;
+
+        for(int i = 0; i < chunk_count; ++i) {
+            const int chunk_x = first_chunk.x + i * CHUNK_SIZE;
+            const int width   = std::min(CHUNK_SIZE, width_ - chunk_x);
+            const std::size_t row = index_of(chunk_x, cell_y);
+            const std::size_t i_row = std::size_t(y) * CHUNK_SIZE;
+
+            for(int x = 0; x < width; ++x) {
+                const MaterialId previous = materials_[row + x], material = cells[i].materials[i_row + x];
+                if(previous == material)
+                    continue;
+
+                --count_changes[previous];
+                ++count_changes[material];
+                if((previous == ParticleType::EMPTY) != (material == ParticleType::EMPTY)) {
+                    occupancy_[occupancy_word_of(chunk_x + x, cell_y)] ^= std::uint32_t(1) << occupancy_bit_of(chunk_x + x);
+                    population_changes[i] += material == ParticleType::EMPTY ? -1 : 1;
+                }
+                materials_[row + x] = material;
+            }
+
+            std::copy_n(&cells[i].lifetimes[i_row],       width, &lifetimes_[row]);
+            std::copy_n(&cells[i].ignition_delays[i_row], width, &ignition_delays_[row]);
+            std::copy_n(&cells[i].color_seeds[i_row],     width, &color_seeds_[row]);
+            std::fill_n(&update_stamps_[row], width, std::uint16_t(update_stamp_ - 1)); // Not updated yet.
         }
     }
 
-    if(furthest_empty_cell.x != cell.x) {
-        swap(cell, furthest_empty_cell);
+    for(int material = 0; material < int(count_changes.size()); ++material) {
+        if(count_changes[material] != 0)
+            material_counts_[material].fetch_add(count_changes[material], std::memory_order_relaxed);
+    }
+
+    for(int i = 0; i < chunk_count; ++i) {
+        chunk_populations_[first_chunk_index + i].fetch_add(population_changes[i], std::memory_order_relaxed);
+
+        const Chunk& chunk = chunks_[first_chunk_index + i];
+        std::map<std::uint64_t, DirtyRect>& timers = timers_[first_chunk_index + i];
+        timers.clear();
+        for(const CellTimer& timer: cells[i].timers)
+            timers[timer.tick].expand(timer.translated(chunk.x, chunk.y).rect);
+    }
+}
+
+void Grid::copy_chunk_stamps_to(const int chunk_index, std::array<std::uint16_t, ChunkCells::SIZE>& stamps) const {
+    const Chunk& chunk = chunks_[chunk_index];
+    const int width  = std::min(CHUNK_SIZE, width_ - chunk.x);
+    const int height = std::min(CHUNK_SIZE, height_ - chunk.y);
+
+    for(int y = 0; y < height; ++y)
+        std::copy_n(&update_stamps_[index_of(chunk.x, chunk.y + y)], width, &stamps[y * CHUNK_SIZE]);
+}
+
+void Grid::copy_chunk_stamps_from(const int chunk_index, const std::array<std::uint16_t, ChunkCells::SIZE>& stamps) {
+    const Chunk& chunk = chunks_[chunk_index];
+    const int width  = std::min(CHUNK_SIZE, width_ - chunk.x);
+    const int height = std::min(CHUNK_SIZE, height_ - chunk.y);
+
+    for(int y = 0; y < height; ++y)
+        std::copy_n(&stamps[y * CHUNK_SIZE], width, &update_stamps_[index_of(chunk.x, chunk.y + y)]);
+}
+
+GridState Grid::save_state() const {
+    GridState state;
+    state.materials       = materials_;
+    state.lifetimes       = lifetimes_;
+    state.ignition_delays = ignition_delays_;
+    state.update_stamps   = update_stamps_;
+    state.color_seeds     = color_seeds_;
+    state.timers          = timers_;
+
+    for(const Chunk& chunk: chunks_) {
+        state.rects.push_back(chunk.rect);
+        state.next_rects.push_back(chunk.next_rect.load());
+    }
+    return state;
+}
+
+void Grid::load_state(const GridState& state) {
+    materials_       = state.materials;
+    lifetimes_       = state.lifetimes;
+    ignition_delays_ = state.ignition_delays;
+    update_stamps_   = state.update_stamps;
+    color_seeds_     = state.color_seeds;
+    timers_          = state.timers;
+
+    for(std::vector<Cell>& requests: leveling_requests_)
+        requests.clear();
+
+    for(std::size_t i = 0; i < chunks_.size(); ++i) {
+        chunks_[i].rect = state.rects[i];
+        chunks_[i].next_rect.store(state.next_rects[i]);
+    }
+    recount_population();
+}
+
+void Grid::update_chunk_rects() {
+    for(Chunk& chunk: chunks_)
+        chunk.update_rect();
+}
+
+void Grid::toggle_occupancy(const std::size_t index) {
+    const int x = int(index % stride_) - BORDER_SIZE, y = int(index / stride_) - BORDER_SIZE;
+    occupancy_[occupancy_word_of(x, y)] ^= std::uint32_t(1) << occupancy_bit_of(x);
+}
+
+void Grid::swap_cells(const std::size_t a, const std::size_t b) {
+    if((materials_[a] == ParticleType::EMPTY) != (materials_[b] == ParticleType::EMPTY)) {
+        toggle_occupancy(a);
+        toggle_occupancy(b);
+    }
+    std::swap(materials_[a], materials_[b]);
+    std::swap(lifetimes_[a], lifetimes_[b]);
+    std::swap(ignition_delays_[a], ignition_delays_[b]);
+    std::swap(update_stamps_[a], update_stamps_[b]);
+    std::swap(color_seeds_[a], color_seeds_[b]);
+}
+
+void Grid::set_cell(const int x, const int y, const MaterialId material) {
+    const std::size_t index = index_of(x, y);
+    const MaterialId previous = materials_[index];
+
+    if(previous != material) {
+        material_counts_[previous].fetch_sub(1, std::memory_order_relaxed);
+        material_counts_[material].fetch_add(1, std::memory_order_relaxed);
+
+        if((previous == ParticleType::EMPTY) != (material == ParticleType::EMPTY)) {
+            toggle_occupancy(index);
+            chunk_populations_[chunk_index_of(x, y)].fetch_add(material == ParticleType::EMPTY ? -1 : 1,
+                                                              std::memory_order_relaxed);
+        }
     }
+
+    const ParticleState state = initial_state_of(material, tick_);
+    materials_[index]       = material;
+    lifetimes_[index]       = state.lifetime;
+    ignition_delays_[index] = state.ignition_delay;
+    update_stamps_[index]   = update_stamp_ - 1; // Not updated yet.
+    color_seeds_[index]     = material == ParticleType::EMPTY ? 0 : gen_random_num(0, 255);
 }
 
-void Grid::reset_has_been_drawn_flags() {
-    for(int i = 0; i < ROWS; ++i) {
-        for(int j = 0; j < COLUMNS; ++j) {
-            if(!is_cell_empty(i, j))
-                at(i, j)->has_been_drawn = false;
+void Grid::recount_population() {
+    std::array<int, 256> material_counts = {};
+    for(int y = 0; y < height_; ++y) {
+        for(int x = 0; x < width_; ++x)
+            ++material_counts[materials_[index_of(x, y)]];
+    }
+    for(std::size_t i = 0; i < material_counts.size(); ++i)
+        material_counts_[i].store(material_counts[i], std::memory_order_relaxed);
+
+    // The unused bits at both ends of every row are set, like the border.
+    std::fill(occupancy_.begin(), occupancy_.end(), ~std::uint32_t(0));
+    for(int y = 0; y < height_; ++y) {
+        for(int x = 0; x < width_; ++x) {
+            if(materials_[index_of(x, y)] == ParticleType::EMPTY)
+                occupancy_[occupancy_word_of(x, y)] &= ~(std::uint32_t(1) << occupancy_bit_of(x));
         }
     }
+
+    for(std::size_t i = 0; i < chunks_.size(); ++i) {
+        const Chunk& chunk = chunks_[i];
+        chunk_populations_[i].store(count_in_region(chunk.x, chunk.y,
+                                                    std::min(chunk.x + CHUNK_SIZE, width_) - 1,
+                                                    std::min(chunk.y + CHUNK_SIZE, height_) - 1),
+                                    std::memory_order_relaxed);
+    }
 }
 
-void Grid::clear() {
-    for(int i = 0; i < ROWS; ++i) {
-        for(int j = 0; j < COLUMNS; ++j) {
-            if(grid[i][j] != NULL) {
-                delete grid[i][j];
-                grid[i][j] = NULL;
-            }
+void Grid::fill_border() {
+    for(int y = -BORDER_SIZE; y < height_ + BORDER_SIZE; ++y) {
+        for(int x = -BORDER_SIZE; x < width_ + BORDER_SIZE; ++x) {
+            if(x < 0 || y < 0 || x >= width_ || y >= height_)
+                materials_[index_of(x, y)] = ParticleType::BORDER;
         }
     }
 }
 
 bool Grid::is_within_bounds(const int x, const int y) {
-    if(x >= 0 && y >= 0 && x < ROWS && y < COLUMNS)
+    if(x >= 0 && y >= 0 && x < width_ && y < height_)
         return true;
     else {
         std::cerr << "Warn: indices out of range: " << x << ' ' << y << '\n';
         return false;
     }
 }
-
-//------------
-//  Utility Functions
-//------------
-glm::vec3 grid_to_ndc(int i, int j, const int width, const int height) {
-    glm::vec3 point;
-    point.x = (((float)i/width)*2)-1;
-    point.y = 1.0*((((float)j/height)*2)-1);
-    point.z = 0.0;
-    return point;
-}
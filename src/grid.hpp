@@ -1,14 +1,26 @@
 #pragma once
 
-#include <glm/vec3.hpp>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <vector>
 
-// Forward declare the class so a Particle
-// data member can be declared.
-class Particle;
+#include "chunk.hpp"
 
 // Settings
-inline const unsigned int ROWS    = 550;
-inline const unsigned int COLUMNS = 550;
+// The size of the grid when none is specified, in cells.
+inline const int DEFAULT_WIDTH  = 550;
+inline const int DEFAULT_HEIGHT = 550;
+
+// The width of the ring of border cells around the grid.
+// The rules read the neighbors of a cell without checking
+// the bounds, so this must be at least 1.
+inline const int BORDER_SIZE = 1;
+
+// Identifies the material stored in a cell, see ParticleType.
+using MaterialId = std::uint8_t;
 
 struct Cell {
 public:
@@ -27,38 +39,253 @@ public:
 };
 
 
+// The cells of a chunk that are woken at a tick, see Grid::wake_at.
+struct CellTimer {
+public:
+    bool operator==(const CellTimer& other) const {
+        return tick == other.tick && rect == other.rect;
+    }
+
+    // The heaps of timers of ChunkCells put the earliest tick first.
+    static bool is_later(const CellTimer& a, const CellTimer& b) {
+        return a.tick > b.tick;
+    }
+
+    CellTimer translated(const int dx, const int dy) const {
+        return {tick, {rect.min_x + dx, rect.min_y + dy, rect.max_x + dx, rect.max_y + dy}};
+    }
+
+public:
+    std::uint64_t tick;
+    DirtyRect rect;
+};
+
+
+// A copy of every per-cell array, chunk rect and timer of a grid.
+struct GridState {
+public:
+    bool operator==(const GridState& other) const;
+    bool operator!=(const GridState& other) const { return !(*this == other); }
+
+public:
+    std::vector<MaterialId>   materials;
+    std::vector<std::int16_t> lifetimes;
+    std::vector<std::uint8_t> ignition_delays;
+    std::vector<std::uint16_t> update_stamps;
+    std::vector<std::uint8_t> color_seeds;
+    std::vector<DirtyRect>    rects, next_rects;
+    std::vector<std::map<std::uint64_t, DirtyRect>> timers;
+};
+
+
+// The state of the cells of a single chunk, stored row by row from the
+// bottom-left corner. SparseWorld and the snapshots store chunks like this.
+struct ChunkCells {
+public:
+    static constexpr int SIZE = CHUNK_SIZE * CHUNK_SIZE;
+
+    std::array<MaterialId, SIZE>    materials;
+    std::array<std::int16_t, SIZE>  lifetimes;
+    std::array<std::uint8_t, SIZE>  ignition_delays;
+    std::array<std::uint8_t, SIZE>  color_seeds;
+
+    // The timers of the chunk as a heap with the earliest tick first, see
+    // CellTimer::is_later, and with the cells relative to its bottom-left
+    // corner. Grid::copy_chunk_to writes them sorted by tick.
+    std::vector<CellTimer> timers;
+};
+
+
 class Grid {
 private:
-    // [0][0] stores the particle at the bottom-left corner of the window.
-    // The interpretation of the matrix can be thought of like so [x][y],
-    // where increases in x stores something farther to the right and 
-    // increases in y stores something that is ascending.
-    Particle* grid[ROWS][COLUMNS];
+    // The size of the grid in cells, without the border.
+    int width_, height_;
+
+    // The number of entries in a row of the arrays and the number of rows.
+    int stride_, padded_height_;
+
+    // The cells are stored as a structure of arrays where every array
+    // has one entry per cell. The grid is surrounded by BORDER_SIZE cells
+    // of the BORDER material, so reading the neighbors of any cell stays
+    // within the arrays. Index 0 stores the bottom-left corner of the
+    // border, increases in x store something farther to the right and
+    // every stride_ entries the row ascends by one.
+    std::vector<MaterialId>   materials_;
+    // The ticks the particle dies at and fire next spreads at, see
+    // MaterialRegistry::has_deadlines.
+    std::vector<std::int16_t> lifetimes_;
+    std::vector<std::uint8_t> ignition_delays_;
+    std::vector<std::uint16_t> update_stamps_;  // The tick the particle was last updated, see mark_updated.
+    std::vector<std::uint8_t> color_seeds_;     // Picks the shade of the particle.
+
+    // The chunks are stored row by row like the cells.
+    std::vector<Chunk> chunks_;
+    int chunk_columns_, chunk_rows_;
+
+    // The current tick and its lower 16 bits.
+    std::uint64_t tick_ = 0;
+    std::uint16_t update_stamp_ = 0;
+
+    // The cells waiting to be woken, one map per chunk from the tick to the
+    // cells woken then. Like the slots of a timer wheel, the cells woken at
+    // the same tick share a timer, which is found in logarithmic time.
+    std::vector<std::map<std::uint64_t, DirtyRect>> timers_;
+
+    // The liquid cells that asked for their body to be leveled
+    // during the current tick, one list per chunk.
+    std::vector<std::vector<Cell>> leveling_requests_;
+
+    // The number of cells of every material, empty cells included. They are
+    // updated as the cells change, by several threads at once during a
+    // parallel tick.
+    std::array<std::atomic<int>, 256> material_counts_;
+
+    // The number of particles in every chunk, which change when a particle
+    // is inserted, removed or moves into another chunk. A query is a single
+    // load, while counting the occupancy bits of a chunk reads 64 words.
+    std::vector<std::atomic<int>> chunk_populations_;
+
+    // One bit per cell that is set when the cell isn't empty, stored row by
+    // row with occupancy_words_ words per row. The border cells and the
+    // unused bits at both ends of a row are set, so scans stop at the edges.
+    int occupancy_words_;
+    std::vector<std::uint32_t> occupancy_;
 
 private:
     bool is_within_bounds(const int x, const int y);
 
+    // The bit of the cell at x is x + OCCUPANCY_OFFSET. Every word then
+    // covers the right half of a chunk and the left half of the next, so
+    // the cells a chunk and its particles can reach are exactly two words.
+    // The chunks of a phase never write to the same word, which lets them
+    // change the bits without atomics.
+    static constexpr int OCCUPANCY_BITS   = 32;
+    static constexpr int OCCUPANCY_OFFSET = CHUNK_SIZE / 2;
+    static_assert(CHUNK_SIZE == OCCUPANCY_BITS, "A word of the occupancy bitmap must span a chunk.");
+    static_assert(OCCUPANCY_OFFSET >= BORDER_SIZE, "The border must fit before the first cell.");
+
+    std::size_t index_of(const int x, const int y) const {
+        return std::size_t(y + BORDER_SIZE) * stride_ + (x + BORDER_SIZE);
+    }
+
+    int chunk_index_of(const int x, const int y) const {
+        return (y / CHUNK_SIZE) * chunk_columns_ + x / CHUNK_SIZE;
+    }
+
+    // Returns the word of the occupancy bitmap storing the bit of the
+    // cell, and where the bit is within it.
+    std::size_t occupancy_word_of(const int x, const int y) const {
+        return std::size_t(y + BORDER_SIZE) * occupancy_words_ + (x + OCCUPANCY_OFFSET) / OCCUPANCY_BITS;
+    }
+    static int occupancy_bit_of(const int x) {
+        return (x + OCCUPANCY_OFFSET) % OCCUPANCY_BITS;
+    }
+
+    // Flips the occupancy bit of the cell at the index of the arrays.
+    void toggle_occupancy(const std::size_t index);
+
+    // Calls the function with every word of the occupancy bitmap that
+    // overlaps the rect, with the bits outside of the rect cleared. The
+    // scan stops early when the function returns false.
+    template<typename Function>
+    void for_each_occupancy_word(const int min_x, const int min_y,
+                                 const int max_x, const int max_y, Function&& function) const;
+
+    // Moves every array entry of both cells.
+    void swap_cells(const std::size_t a, const std::size_t b);
+
+    // Sets the material of the cell and resets the rest of its state.
+    void set_cell(const int x, const int y, const MaterialId material);
+
+    // Counts the cells of every material and rebuilds
+    // the occupancy bitmap from scratch.
+    void recount_population();
+
+    // Sets the material of every cell of the border.
+    void fill_border();
+
 public:
-    Grid();
+    // The cells are allocated on the heap, so the size is only limited by
+    // the memory. Both must be at least 1.
+    Grid(const int width = DEFAULT_WIDTH, const int height = DEFAULT_HEIGHT);
     ~Grid();
     Grid(const Grid& other)           = delete;
     Grid(Grid&& other)                = delete;
     Grid operator=(const Grid& other) = delete;
     Grid operator=(Grid&& other)      = delete;
 
-    // Returns the item at the position specified.
-    Particle* & at(const int i, const int j);
-    Particle* & at(const Cell cell);
+    int get_width()  const { return width_; }
+    int get_height() const { return height_; }
+
+    // Returns the material at the position specified.
+    MaterialId at(const int i, const int j) const;
+    MaterialId at(const Cell cell) const;
+
+    // Returns the material at the position specified without checking
+    // the bounds, which is meant for the rules. The cells within
+    // BORDER_SIZE of the grid are valid and store BORDER.
+    MaterialId unchecked_at(const int i, const int j) const {
+        assert(i >= -BORDER_SIZE && j >= -BORDER_SIZE &&
+               i < width_ + BORDER_SIZE && j < height_ + BORDER_SIZE);
+        return materials_[index_of(i, j)];
+    }
+    MaterialId unchecked_at(const Cell cell) const {
+        return unchecked_at(cell.x, cell.y);
+    }
 
-    void insert(const int x, const int y, Particle* particle);
-    void insert(const Cell cell, Particle* particle);
+    // Access the per-cell state of the particle at the position specified.
+    std::int16_t& lifetime(const Cell cell)       { return lifetimes_[index_of(cell.x, cell.y)]; }
+    std::uint8_t& ignition_delay(const Cell cell) { return ignition_delays_[index_of(cell.x, cell.y)]; }
+    std::int16_t  lifetime(const Cell cell)    const { return lifetimes_[index_of(cell.x, cell.y)]; }
+    std::uint8_t  color_seed(const Cell cell)  const { return color_seeds_[index_of(cell.x, cell.y)]; }
+
+    void insert(const int x, const int y, const MaterialId material);
+    void insert(const Cell cell, const MaterialId material);
     void remove(const int x, const int y);
 
-    // Returns the number of items in the grid.
+    // Replaces the particle in the cell with a new particle of the material
+    // specified. This is used for reactions, like wood turning into fire.
+    void convert(const Cell cell, const MaterialId material);
+
+    // Returns the number of particles in the grid.
     int count() const;
 
-    bool is_cell_empty(const int i, const int j) const;
-    bool is_cell_empty(Cell cell);
+    // Returns the number of particles of the material in the grid.
+    int count_of(const MaterialId material) const {
+        return material_counts_[material].load(std::memory_order_relaxed);
+    }
+
+    // Returns the number of particles in the chunk.
+    int chunk_population(const int chunk_index) const {
+        return chunk_populations_[chunk_index].load(std::memory_order_relaxed);
+    }
+    bool is_chunk_empty(const int chunk_index) const { return chunk_population(chunk_index) == 0; }
+
+    // Returns the number of particles within the rect. The rect must be
+    // within the grid, like the rest of the region queries.
+    int count_in_region(const int min_x, const int min_y, const int max_x, const int max_y) const;
+
+    bool is_region_empty(const int min_x, const int min_y, const int max_x, const int max_y) const;
+
+    // The position must be within BORDER_SIZE of the grid, border cells
+    // aren't empty.
+    bool is_cell_empty(const int i, const int j) const {
+        assert(i >= -BORDER_SIZE && j >= -BORDER_SIZE &&
+               i < width_ + BORDER_SIZE && j < height_ + BORDER_SIZE);
+        return !((occupancy_[occupancy_word_of(i, j)] >> occupancy_bit_of(i)) & 1);
+    }
+    bool is_cell_empty(Cell cell) const {
+        return is_cell_empty(cell.x, cell.y);
+    }
+
+    // Returns the first x from x to max_x where the cell of the row isn't
+    // empty, or max_x + 1 when they all are.
+    int next_occupied_x(const int x, const int y, const int max_x) const;
+
+    // Returns the number of empty cells next to the cell in the direction,
+    // stopping at the first cell that isn't empty or after limit cells.
+    int count_empty_left_of(const Cell cell, const int limit) const;
+    int count_empty_right_of(const Cell cell, const int limit) const;
 
     // Moves the cell to the destination or as close
     // as possible if there are any filled cells inbetween.
@@ -70,25 +297,116 @@ public:
     // Returns the new location of the cell that is moved.
     void move_cell_right_until_blocked(Cell cell, const int times);
 
-    // Swaps the values in both positions specified.
+    // Swaps the values in both positions specified. The positions are
+    // not checked, the rules only swap with cells they found empty,
+    // which are never outside of the grid.
     void swap(const int i1, const int j1, const int i2, const int j2);
 
     // Swaps the values in both cells specified.
     void swap(const Cell cell1, const Cell cell2);
 
-    // This should be called once per frame to ensure
-    // the particles are only updated once per frame.
-    void reset_has_been_drawn_flags();
+    // A particle is updated at most once per tick. Every cell stores the
+    // tick during which its particle was last updated, so nothing has to be
+    // reset when a tick starts. Only 16 bits of the tick are stored, which
+    // makes a particle that wasn't updated for exactly a multiple of 65536
+    // ticks skip a single update. That is harmless.
+    void begin_tick(const std::uint64_t tick) {
+        tick_         = tick;
+        update_stamp_ = std::uint16_t(tick);
+    }
 
-    // Frees all the stored pointers.
+    // Returns the tick passed to begin_tick.
+    std::uint64_t get_tick() const { return tick_; }
+
+    // Marks the particle as updated during the current tick.
+    // Returns false when it already was updated.
+    bool mark_updated(const int i, const int j) {
+        std::uint16_t& stamp = update_stamps_[index_of(i, j)];
+        if(stamp == update_stamp_)
+            return false;
+        stamp = update_stamp_;
+        return true;
+    }
+
+    // Empties every cell.
     // This can "clear" the data from the window.
     void clear();
-};
 
-//-------------------
-// Utility Functions
-//-------------------
+    // Marks the cell and its neighbors as changed so their chunks are
+    // simulated during the next tick. Every function that modifies a
+    // cell calls this, the rules only need it when a particle must keep
+    // updating without changing, like a countdown.
+    void keep_awake(const Cell cell);
+
+    // Marks every cell within the rect and their neighbors as changed.
+    void keep_awake(const int min_x, const int min_y, const int max_x, const int max_y);
+
+    // Wakes the cell alone during the tick, or the next tick when it
+    // already came. This is for particles that have nothing to do until
+    // then, like a fire waiting to ignite its neighbors, which sleep
+    // instead of keeping their chunk awake. The timers of a chunk aren't
+    // shared between threads, so only the rules updating the cell and the
+    // code running between ticks may call this. A cell woken earlier by
+    // its neighbors is woken again by the timer, which is harmless.
+    //
+    // The timer of a chunk that is due at the same tick grows to cover the
+    // cell instead, so the gas piled up in a chunk, which dies at the same
+    // tick, takes a single timer however often its particles go to sleep.
+    void wake_at(const Cell cell, const std::uint64_t tick);
+
+    // Wakes the cells whose timer is due at the current tick. This is
+    // called after begin_tick and before update_chunk_rects.
+    void wake_due_cells();
+
+    // Asks for the body of liquid the cell belongs to to be leveled once
+    // the chunks of the tick are updated, see LiquidLeveler. Like wake_at,
+    // only the rules updating the cell may call this. The requests only
+    // last until the end of the tick, so they aren't part of the state.
+    void request_leveling(const Cell cell) {
+        leveling_requests_[chunk_index_of(cell.x, cell.y)].push_back(cell);
+    }
+    std::vector<std::vector<Cell>>& leveling_requests() { return leveling_requests_; }
+
+    // Returns the materials of the row indexed by x, which is meant for
+    // passes over whole rows. The border cells are outside of [0, width).
+    const MaterialId* materials_of_row(const int y) const {
+        return &materials_[index_of(0, y)];
+    }
 
-// Convert from the grid with the ranges [0, ROWS] and [0, COLUMNS] to ndc.
-// Opengl expects vertices between [-1, 1] and a y-axis pointing up.
-glm::vec3 grid_to_ndc(int i, int j, const int width, const int height);
+    // Moves the particle into the empty cell below it. Unlike swap, this
+    // doesn't wake the cells, a pass moving a whole row of particles
+    // wakes them all at once with keep_awake.
+    void drop(const int x, const int y);
+
+    // Copy the cells and the timers of a chunk. The cells of the chunks at
+    // the edges that are outside of the grid are skipped, and empty in the
+    // copy. The copied particles aren't marked as updated.
+    void copy_chunk_to(const int chunk_index, ChunkCells& cells) const;
+    void copy_chunk_from(const int chunk_index, const ChunkCells& cells);
+
+    // Copies the cells of consecutive chunks of a row of chunks. The rows
+    // of cells are then written in order, which is much faster than
+    // copying the chunks one by one when most of a large grid is copied.
+    void copy_chunks_from(const int first_chunk_index, const int chunk_count, const ChunkCells* cells);
+
+    // Copy the update stamps of a chunk, see begin_tick. A chunk that moves
+    // to another grid during a tick keeps its particles updated with these.
+    void copy_chunk_stamps_to(const int chunk_index, std::array<std::uint16_t, ChunkCells::SIZE>& stamps) const;
+    void copy_chunk_stamps_from(const int chunk_index, const std::array<std::uint16_t, ChunkCells::SIZE>& stamps);
+
+    // The timers of a chunk by the tick they are due at, with the cells
+    // in grid coordinates.
+    std::map<std::uint64_t, DirtyRect>& chunk_timers(const int chunk_index) { return timers_[chunk_index]; }
+
+    std::vector<Chunk>& chunks()             { return chunks_; }
+    const std::vector<Chunk>& chunks() const { return chunks_; }
+
+    // Copies the state of every cell and chunk, which is used
+    // to restore or to compare the state of the grid.
+    GridState save_state() const;
+    void load_state(const GridState& state);
+
+    // Makes the cells that changed during the previous tick the
+    // cells that are simulated during the current tick.
+    void update_chunk_rects();
+};
@@ -0,0 +1,104 @@
+#include <cassert>
+
+#include <glad/glad.h>
+
+#include "instance_renderer.hpp"
+
+// Packs the cell and its palette index into a single instance.
+static std::uint32_t pack_instance(const int x, const int y, const std::uint8_t palette_index) {
+    return std::uint32_t(x) | std::uint32_t(y) << 12 | std::uint32_t(palette_index) << 24;
+}
+
+InstanceRenderer::InstanceRenderer(const int width, const int height)
+    : width_(width), height_(height),
+      shader_("./shaders/shader.vs", "./shaders/shader.fs"),
+      max_frame_size_(std::size_t(width) * height * sizeof(std::uint32_t)),
+      buffer_size_(max_frame_size_ * FRAMES_IN_FLIGHT) {
+    assert(can_draw(width, height));
+    float vertices[] = {
+         0.0f, 0.0f, 1.0f
+    };
+
+    glPointSize(2);
+
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &vertex_vbo_);
+    glGenBuffers(1, &instance_vbo_);
+
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // The storage is allocated once and reused by every frame.
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+    glBufferData(GL_ARRAY_BUFFER, buffer_size_, nullptr, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    shader_.use();
+    shader_.setInt("palette", 0);
+    glUniform2f(glGetUniformLocation(shader_.ID, "gridSize"), float(width_), float(height_));
+}
+
+InstanceRenderer::~InstanceRenderer() {
+    glDeleteBuffers(1, &instance_vbo_);
+    glDeleteBuffers(1, &vertex_vbo_);
+    glDeleteVertexArrays(1, &vao_);
+}
+
+void InstanceRenderer::draw(const Snapshot& snapshot) {
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo_);
+
+    if(snapshot.sequence != uploaded_sequence_) {
+        // Start over in fresh storage once the rest of the
+        // buffer can't hold a frame with every cell filled.
+        if(buffer_offset_ + max_frame_size_ > buffer_size_) {
+            glBufferData(GL_ARRAY_BUFFER, buffer_size_, nullptr, GL_STREAM_DRAW);
+            buffer_offset_ = 0;
+        }
+
+        // Nothing reads the part of the buffer behind the previous
+        // frame, so there's no need to wait for the GPU.
+        auto* instances = static_cast<std::uint32_t*>(glMapBufferRange(
+            GL_ARRAY_BUFFER, buffer_offset_, max_frame_size_,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+            GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
+
+        instance_count_ = 0;
+        if(instances != nullptr) {
+            // Palette index 0 is an empty cell.
+            const std::uint8_t* palette_index = snapshot.palette_indices.data();
+            for(int y = 0; y < height_; ++y) {
+                for(int x = 0; x < width_; ++x, ++palette_index) {
+                    if(*palette_index != 0)
+                        instances[instance_count_++] = pack_instance(x, y, *palette_index);
+                }
+            }
+            glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, instance_count_ * sizeof(std::uint32_t));
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+
+        instance_offset_    = buffer_offset_;
+        buffer_offset_     += instance_count_ * sizeof(std::uint32_t);
+        uploaded_sequence_  = snapshot.sequence;
+    }
+
+    // The instances of this snapshot start at the offset.
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(std::uint32_t), (void*)instance_offset_);
+
+    if(instance_count_ > 0) {
+        shader_.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, palette_.ID);
+        glDrawArraysInstanced(GL_POINTS, 0, 1, instance_count_);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gl_objects.hpp"
+#include "shader.hpp"
+#include "simulation_thread.hpp"
+
+// Draws a point per particle with instancing. Every instance is packed
+// into 32 bits, the x and y of the cell (12 bits each) and its palette
+// index (8 bits), which the vertex shader expands.
+//
+// The instances are streamed through one buffer that is allocated once.
+// Every frame writes behind the previous one like a ring buffer, so the
+// GPU can still read the older instances, and the buffer is orphaned
+// when it is full, which lets the driver hand out fresh storage.
+class InstanceRenderer {
+public:
+    // Frames of instances that fit in the buffer when every cell is filled.
+    static constexpr int FRAMES_IN_FLIGHT = 3;
+
+    // The cell coordinates are stored with 12 bits each.
+    static constexpr int MAX_GRID_SIZE = 4096;
+
+public:
+    // The grid must fit in the packed instances, see can_draw.
+    InstanceRenderer(const int width, const int height);
+    ~InstanceRenderer();
+    InstanceRenderer(const InstanceRenderer& other)            = delete;
+    InstanceRenderer& operator=(const InstanceRenderer& other) = delete;
+
+    void draw(const Snapshot& snapshot);
+
+    static bool can_draw(const int width, const int height) {
+        return width <= MAX_GRID_SIZE && height <= MAX_GRID_SIZE;
+    }
+
+private:
+    int width_, height_;
+    unsigned int vao_, vertex_vbo_, instance_vbo_;
+    PaletteTexture palette_;
+    Shader shader_;
+
+    std::size_t max_frame_size_;  // The bytes written when every cell is filled.
+    std::size_t buffer_size_;
+    std::size_t buffer_offset_ = 0;
+
+    // The instances of the latest snapshot, which are
+    // drawn again until there's a new snapshot.
+    std::uint64_t uploaded_sequence_ = 0;
+    std::size_t instance_offset_     = 0;
+    int instance_count_              = 0;
+};
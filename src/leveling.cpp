@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "leveling.hpp"
+#include "material.hpp"
+
+int LiquidLeveler::level_liquids(Grid& grid) {
+    std::vector<std::vector<Cell>>& requests = grid.leveling_requests();
+    const bool has_requests = std::any_of(requests.begin(), requests.end(), [](const std::vector<Cell>& cells) {
+        return !cells.empty();
+    });
+    if(!has_requests)
+        return 0;
+
+    begin(grid);
+    int moved = 0;
+    for(std::vector<Cell>& chunk_requests: requests) {
+        for(const Cell cell: chunk_requests)
+            moved += level(cell);
+        chunk_requests.clear();
+    }
+    end();
+    return moved;
+}
+
+void LiquidLeveler::begin(Grid& grid) {
+    grid_          = &grid;
+    width_         = grid.get_width();
+    height_        = grid.get_height();
+    chunk_columns_ = (width_ + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    spans_.resize(height_);
+    column_moves_.resize(width_, 0);
+
+    // Ties go to the left during even ticks and to the right during odd
+    // ones, so the liquid doesn't drift towards one side.
+    const int side = grid.get_tick() % 2 == 0 ? 1 : -1;
+    source_order_ = {side, false};
+    target_order_ = {side, true};
+
+    const std::vector<Chunk>& chunks = grid.chunks();
+    const int chunk_rows = int(chunks.size()) / chunk_columns_;
+    reach_of_chunk_.assign(chunks.size(), Reach::UNKNOWN);
+    for(int i = 0; i < int(chunks.size()); ++i) {
+        if(!chunks[i].is_awake())
+            continue;
+
+        const int chunk_x = i % chunk_columns_, chunk_y = i / chunk_columns_;
+        for(int y = std::max(chunk_y - 1, 0); y <= std::min(chunk_y + 1, chunk_rows - 1); ++y) {
+            for(int x = std::max(chunk_x - 1, 0); x <= std::min(chunk_x + 1, chunk_columns_ - 1); ++x)
+                reach_of_chunk_[y * chunk_columns_ + x] = Reach::REACHABLE;
+        }
+    }
+}
+
+void LiquidLeveler::end() {
+    for(const int y: found_rows_)
+        spans_[y].clear();
+    found_rows_.clear();
+    grid_ = nullptr;
+}
+
+int LiquidLeveler::level(const Cell cell) {
+    const MaterialId material = grid_->unchecked_at(cell);
+    if(material_registry().phase_of(material) != Phase::LIQUID || is_found(cell))
+        return 0;
+
+    find_body(cell, material);
+    const int moved = move_columns(material);
+
+    sources_.clear();
+    targets_.clear();
+    for(const int x: moved_columns_)
+        column_moves_[x] = 0;
+    moved_columns_.clear();
+    return moved;
+}
+
+// A body can stretch over sleeping chunks, which hold particles the
+// grid keeps up to date. The empty ones only take particles next to
+// the awake chunks, since a SparseWorld doesn't load the rest of the
+// world into the grid.
+bool LiquidLeveler::is_reachable(const Cell cell) {
+    if(cell.x < 0 || cell.y < 0 || cell.x >= width_ || cell.y >= height_)
+        return false;
+
+    const int chunk_index = (cell.y / CHUNK_SIZE) * chunk_columns_ + cell.x / CHUNK_SIZE;
+    Reach& reach = reach_of_chunk_[chunk_index];
+    if(reach == Reach::UNKNOWN)
+        reach = grid_->is_chunk_empty(chunk_index) ? Reach::UNREACHABLE : Reach::REACHABLE;
+    return reach == Reach::REACHABLE;
+}
+
+bool LiquidLeveler::is_found(const Cell cell) const {
+    for(const Span& span: spans_[cell.y]) {
+        if(cell.x >= span.min_x && cell.x <= span.max_x)
+            return true;
+    }
+    return false;
+}
+
+void LiquidLeveler::push_source(const Cell cell) {
+    sources_.push_back(cell);
+    std::push_heap(sources_.begin(), sources_.end(), source_order_);
+}
+
+void LiquidLeveler::pop_source() {
+    std::pop_heap(sources_.begin(), sources_.end(), source_order_);
+    sources_.pop_back();
+}
+
+void LiquidLeveler::pop_target() {
+    std::pop_heap(targets_.begin(), targets_.end(), target_order_);
+    targets_.pop_back();
+}
+
+// A particle only moves into an empty cell that rests on something,
+// the liquid pours off ledges by falling instead.
+bool LiquidLeveler::is_target(const Cell cell) {
+    return is_reachable(cell) && grid_->is_cell_empty(cell) && !grid_->is_cell_empty(cell.down());
+}
+
+void LiquidLeveler::push_target(const Cell cell) {
+    if(!is_target(cell))
+        return;
+    targets_.push_back(cell);
+    std::push_heap(targets_.begin(), targets_.end(), target_order_);
+}
+
+void LiquidLeveler::find_body(const Cell cell, const MaterialId material) {
+    seeds_.clear();
+    seeds_.push_back(cell);
+
+    // The seeds are taken in the order they were found, so the
+    // body spreads out evenly from the cell until the limit.
+    int found_cells = 0;
+    for(std::size_t next = 0; next < seeds_.size() && found_cells < MAX_BODY_CELLS; ++next) {
+        const Cell seed = seeds_[next];
+        if(!is_reachable(seed) || grid_->unchecked_at(seed) != material || is_found(seed))
+            continue;
+
+        const int y = seed.y;
+        int min_x = seed.x, max_x = seed.x;
+        while(is_reachable(Cell(min_x - 1, y)) && grid_->unchecked_at(min_x - 1, y) == material)
+            --min_x;
+        while(is_reachable(Cell(max_x + 1, y)) && grid_->unchecked_at(max_x + 1, y) == material)
+            ++max_x;
+        if(spans_[y].empty())
+            found_rows_.push_back(y);
+        spans_[y].push_back({min_x, max_x});
+        found_cells += max_x - min_x + 1;
+
+        push_target(Cell(min_x - 1, y));
+        push_target(Cell(max_x + 1, y));
+
+        // One seed per run of liquid above and below the span.
+        for(int x = min_x; x <= max_x; ++x) {
+            if(grid_->unchecked_at(x, y + 1) != material) {
+                push_source(Cell(x, y));
+                push_target(Cell(x, y + 1));
+            }
+            else if(x == min_x || grid_->unchecked_at(x - 1, y + 1) != material) {
+                seeds_.push_back(Cell(x, y + 1));
+            }
+
+            if(grid_->unchecked_at(x, y - 1) == material &&
+               (x == min_x || grid_->unchecked_at(x - 1, y - 1) != material))
+                seeds_.push_back(Cell(x, y - 1));
+        }
+    }
+}
+
+int LiquidLeveler::move_columns(const MaterialId material) {
+    const int dispersion_rate = material_registry().dispersion_rate_of(material);
+    int moved = 0;
+
+    while(!sources_.empty() && !targets_.empty()) {
+        // The heaps hold cells that earlier moves changed, which are skipped.
+        const Cell source = sources_.front();
+        if(grid_->unchecked_at(source) != material || grid_->unchecked_at(source.up()) == material ||
+           column_moves_[source.x] >= dispersion_rate) {
+            pop_source();
+            continue;
+        }
+        const Cell target = targets_.front();
+        if(!is_target(target) || (grid_->unchecked_at(target.left()) != material &&
+                                  grid_->unchecked_at(target.right()) != material &&
+                                  grid_->unchecked_at(target.down()) != material)) {
+            pop_target();
+            continue;
+        }
+        if(target.y >= source.y)
+            break;
+
+        pop_source();
+        pop_target();
+        grid_->swap(source, target);
+        if(column_moves_[source.x]++ == 0)
+            moved_columns_.push_back(source.x);
+        ++moved;
+
+        // The column sank by a cell, and the particle
+        // moved next to the empty cells around it.
+        if(is_reachable(source.down()) && grid_->unchecked_at(source.down()) == material)
+            push_source(source.down());
+        push_target(target.left());
+        push_target(target.right());
+        push_target(target.up());
+    }
+    return moved;
+}
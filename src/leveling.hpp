@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "grid.hpp"
+
+// Levels the bodies of liquid whose surface particles asked for it during
+// the tick, see Grid::request_leveling. A body is found a horizontal span
+// of liquid at a time, like a scanline flood fill. Then the tops of its
+// highest columns move to the lowest empty cells that touch it, wherever
+// they are, until no empty cell is lower than the highest column or the
+// columns sank by the dispersion rate of the liquid. A pool then levels
+// out in a few ticks and the water of communicating vessels rises in the
+// lower one, instead of particles random walking over the surface.
+//
+// This runs on the calling thread once the chunks of the tick are updated,
+// so a body can span several chunks, sleeping ones included. The particles
+// only move into empty chunks next to the chunks that were awake during the
+// tick, like the rules. A grid only holds part of a SparseWorld, so a body
+// is cut off at the edges of the grid and the rest of it levels when its
+// own island asks.
+class LiquidLeveler {
+public:
+    // The most cells of a body a request finds, the spans nearest to the
+    // particle that asked first. A larger body levels by parts instead, as
+    // the particles of its surface ask, which keeps the cost of a request
+    // bounded however large the sea it belongs to is.
+    static constexpr int MAX_BODY_CELLS = 1 << 18;
+
+    // The buffers are kept between ticks, and resized when the grid is.
+    // Returns the number of particles that moved.
+    int level_liquids(Grid& grid);
+
+private:
+    enum class Reach: std::uint8_t {
+        UNKNOWN,
+        REACHABLE,
+        UNREACHABLE
+    };
+
+    struct Span {
+        int min_x, max_x;
+    };
+
+    // Orders a heap of cells by their row, the highest first for the
+    // sources and the lowest first for the targets, then by their column.
+    struct HeapOrder {
+        int side;
+        bool is_lowest_first;
+
+        bool operator()(const Cell a, const Cell b) const {
+            if(a.y != b.y)
+                return is_lowest_first ? a.y > b.y : a.y < b.y;
+            return a.x * side > b.x * side;
+        }
+    };
+
+private:
+    // Prepares the buffers for the tick of the grid.
+    void begin(Grid& grid);
+
+    // Forgets the bodies found during the tick.
+    void end();
+
+    // Levels the body of the liquid cell, unless it was leveled already
+    // during the tick. Returns the number of particles that moved.
+    int level(const Cell cell);
+
+    bool is_reachable(const Cell cell);
+    bool is_found(const Cell cell) const;
+
+    void push_source(const Cell cell);
+    void pop_source();
+    void pop_target();
+
+    bool is_target(const Cell cell);
+    void push_target(const Cell cell);
+
+    // Finds the spans of the body, the top of each of its columns and
+    // the empty cells next to it, up to MAX_BODY_CELLS.
+    void find_body(const Cell cell, const MaterialId material);
+
+    // Moves the tops of the highest columns into the lowest empty cells
+    // until they're level or the columns sank by the dispersion rate.
+    int move_columns(const MaterialId material);
+
+private:
+    Grid* grid_ = nullptr;
+    int width_ = 0, height_ = 0;
+    int chunk_columns_ = 0;
+    HeapOrder source_order_{1, false}, target_order_{1, true};
+
+
+    // Whether the chunks are reachable, found out as the bodies reach them.
+    std::vector<Reach> reach_of_chunk_;
+
+    // The spans of every body found during the tick, row by row, and
+    // the rows that hold any.
+    std::vector<std::vector<Span>> spans_;
+    std::vector<int> found_rows_;
+
+    std::vector<Cell> seeds_, sources_, targets_;
+
+    // The number of particles each column gave during the tick.
+    std::vector<int> column_moves_;
+    std::vector<int> moved_columns_;
+};
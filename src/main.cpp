@@ -10,6 +10,12 @@
 #include <glad/glad.h>
 #endif
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/ext/matrix_transform.hpp>
@@ -17,34 +23,105 @@
 #include "particle_system.hpp"
 #include "glfw_wrapper.hpp"
 #include "imgui_wrapper.hpp"
-#include "gl_objects.hpp"
+#include "material.hpp"
+#include "recording.hpp"
+#include "simulation_thread.hpp"
 #include "timer.hpp"
+#include "world.hpp"
+
+// The length of the longer side of the window in pixels.
+static const int WINDOW_SIZE = 550;
+
+static void print_usage() {
+    std::cerr << "Usage: crumble [--width n] [--height n] [--materials path] [--record path] [--replay path]\n";
+}
+
+int main(int argc, char* argv[]) {
+    // The size of the world in cells, which is independent of the window.
+    int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
 
-inline Grid GRID;
+    // The definition file of the materials. The default materials are
+    // built in, so the default file is only loaded when it is there.
+    std::string materials_path = MATERIALS_PATH;
+    bool has_materials_path    = false;
+
+    // Records the session until the window is closed, or replays one.
+    std::string record_path, replay_path;
+
+    for(int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value  = i + 1 < argc;
+
+        if(arg == "--width" && has_value) {
+            width = std::atoi(argv[++i]);
+        }
+        else if(arg == "--height" && has_value) {
+            height = std::atoi(argv[++i]);
+        }
+        else if(arg == "--materials" && has_value) {
+            materials_path     = argv[++i];
+            has_materials_path = true;
+        }
+        else if(arg == "--record" && has_value) {
+            record_path = argv[++i];
+        }
+        else if(arg == "--replay" && has_value) {
+            replay_path = argv[++i];
+        }
+        else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
 
-int main() {
-    GlfwWrapper glfw(550, 550, "Crumble");
+    if(width < 1 || height < 1) {
+        std::cerr << "The width and height must be at least 1\n";
+        return EXIT_FAILURE;
+    }
+
+    if((has_materials_path || std::ifstream(materials_path)) && !load_materials(materials_path))
+        return EXIT_FAILURE;
+
+    // A replay runs in a world like the recorded one, as fast as possible.
+    Recording recording, replay;
+    if(!replay_path.empty()) {
+        if(!load_recording(replay_path, replay))
+            return EXIT_FAILURE;
+        width  = replay.width;
+        height = replay.height;
+        ParticleSystem::s_is_tick_rate_unlimited = true;
+    }
+
+    // The window keeps the aspect ratio of the world.
+    const int longer_side = std::max(width, height);
+    GlfwWrapper glfw(std::max(1, WINDOW_SIZE * width / longer_side),
+                     std::max(1, WINDOW_SIZE * height / longer_side), "Crumble");
     glfw.set_callbacks();
     ImguiWrapper imgui(glfw.get_window());
-    ParticleSystem particle_system(glfw.get_window());
+    World world(replay.seed, 0, width, height);
+    SimulationThread simulation_thread(world, ParticleSystem::s_is_tick_rate_unlimited ?
+                                       SimulationThread::UNLIMITED_TICK_RATE : ParticleSystem::s_tick_rate,
+                                       record_path.empty() ? nullptr : &recording,
+                                       replay_path.empty() ? nullptr : &replay);
+    ParticleSystem particle_system(glfw.get_window(), simulation_thread, width, height);
     Timer frame_timer;
 
-    // Setup the graphics pipeline with the corresonding fragment and vertex shader.
-    Shader ourShader("./shaders/shader.vs", "./shaders/shader.fs");
-    Point point;
-
     // The render loop.
     while (!glfwWindowShouldClose(glfw.get_window())) {
         imgui.render_loop_iteration();
 
-        //ImGui::ShowDemoWindow();
-        display_particle_options_menu(frame_timer.get_prev_elapsed_time().count());
-
         particle_system.process_input(glfw.get_window());
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT); 
 
-        particle_system.draw(point.VAO, ourShader);
+        // Draw the latest state published by the simulation thread, which
+        // keeps ticking at its own rate while the frame is being drawn.
+        simulation_thread.read_snapshot([&](const Snapshot& snapshot) {
+            //ImGui::ShowDemoWindow();
+            display_particle_options_menu(frame_timer.get_prev_elapsed_time().count(),
+                                          simulation_thread, snapshot);
+            particle_system.draw(snapshot);
+        });
 
         glfw.poll_events();
 
@@ -54,5 +131,9 @@ int main() {
         frame_timer.start();
     }
 
+    simulation_thread.stop();
+    if(!record_path.empty() && !save_recording(recording, record_path))
+        return EXIT_FAILURE;
+
     return (EXIT_SUCCESS);
 }
@@ -0,0 +1,392 @@
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "default_materials.hpp"
+#include "material.hpp"
+#include "particle_types.hpp"
+
+// The first line of every definition file, followed by the version.
+static const char* MATERIALS_HEADER = "crumble-materials";
+static const int MATERIALS_VERSION  = 1;
+
+static bool parse_phase(const std::string& text, Phase& phase) {
+    if(text == "powder")      phase = Phase::POWDER;
+    else if(text == "liquid") phase = Phase::LIQUID;
+    else if(text == "solid")  phase = Phase::SOLID;
+    else if(text == "gas")    phase = Phase::GAS;
+    else if(text == "plasma") phase = Phase::PLASMA;
+    else                      return false;
+    return true;
+}
+
+static bool parse_direction(const std::string& text, Direction& direction) {
+    if(text == "up")              direction = Direction::UP;
+    else if(text == "down")       direction = Direction::DOWN;
+    else if(text == "left")       direction = Direction::LEFT;
+    else if(text == "right")      direction = Direction::RIGHT;
+    else if(text == "up_right")   direction = Direction::UP_RIGHT;
+    else if(text == "up_left")    direction = Direction::UP_LEFT;
+    else if(text == "down_right") direction = Direction::DOWN_RIGHT;
+    else if(text == "down_left")  direction = Direction::DOWN_LEFT;
+    else                          return false;
+    return true;
+}
+
+// Returns the ID the material will have, EMPTY for "none" and -1 when
+// there is no material with the name.
+static int find_definition(const std::vector<MaterialDefinition>& definitions, const std::string& name) {
+    if(name == "none")
+        return ParticleType::EMPTY;
+
+    for(std::size_t i = 0; i < definitions.size(); ++i) {
+        if(definitions[i].name == name)
+            return int(i) + 1;
+    }
+    return -1;
+}
+
+static void add_to_fingerprint(std::uint64_t& fingerprint, const std::uint64_t value) {
+    fingerprint = mix_bits(fingerprint + 0x9E3779B97F4A7C15ull + value);
+}
+
+static void add_to_fingerprint(std::uint64_t& fingerprint, const std::string& text) {
+    add_to_fingerprint(fingerprint, text.size());
+    for(const char c: text)
+        add_to_fingerprint(fingerprint, std::uint8_t(c));
+}
+
+static bool is_color_valid(const Color3 color) {
+    for(int i = 0; i < 3; ++i) {
+        if(!(color[i] >= 0.0f && color[i] <= 1.0f))
+            return false;
+    }
+    return true;
+}
+
+MaterialRegistry::MaterialRegistry() {
+    std::istringstream stream(DEFAULT_MATERIALS);
+    std::vector<MaterialDefinition> definitions;
+
+    const bool is_valid = parse_materials(stream, "the default materials", definitions) && define(definitions);
+    assert(is_valid && count_ == ParticleType::COUNT);
+    (void)is_valid;
+}
+
+std::string MaterialRegistry::check(const MaterialDefinition& definition,
+                                    const std::vector<MaterialDefinition>& definitions) {
+    const bool has_lifetime = definition.phase == Phase::GAS || definition.phase == Phase::PLASMA;
+
+    if(definition.phase == Phase::NONE)
+        return "it has no phase";
+    if(definition.density < 0)
+        return "its density is negative";
+    if(definition.dispersion_rate < 0 || definition.dispersion_rate > MAX_DISPERSION_RATE)
+        return "its dispersion must be within 0 and " + std::to_string(MAX_DISPERSION_RATE);
+    if(definition.lifetime < (has_lifetime ? 1 : 0) || definition.lifetime > INT16_MAX)
+        return "its lifetime must be within " + std::to_string(has_lifetime ? 1 : 0) + " and " + std::to_string(INT16_MAX);
+    if(definition.phase == Phase::PLASMA && (definition.ignition_delay < 1 || definition.ignition_delay > INT8_MAX))
+        return "its ignition_delay must be within 1 and " + std::to_string(INT8_MAX);
+    if(definition.spread_chance < 0 || definition.spread_chance > 100)
+        return "its spread must be within 0 and 100";
+    if(!is_color_valid(definition.color_from) || !is_color_valid(definition.color_to))
+        return "its color must be within 0 and 1";
+
+    int total_weight = 0;
+    for(const DirectionWeight& weight: definition.movement) {
+        if(weight.weight < 0)
+            return "its movement has a negative weight";
+        if(weight.weight > MAX_MOVEMENT_WEIGHT - total_weight)
+            return "its movement weights must add up to at most " + std::to_string(MAX_MOVEMENT_WEIGHT);
+        total_weight += weight.weight;
+    }
+    if(definition.phase == Phase::GAS && total_weight <= 0)
+        return "it needs movement weights";
+
+    for(std::size_t i = 0; i < definition.reactions.size(); ++i) {
+        const ReactionDefinition& reaction = definition.reactions[i];
+        const int agent = find_definition(definitions, reaction.agent);
+
+        if(agent <= 0 || definitions[agent - 1].phase != Phase::PLASMA)
+            return "its reaction with " + reaction.agent + " needs a plasma as the agent";
+        if(find_definition(definitions, reaction.product) < 0)
+            return "its reaction with " + reaction.agent + " has an unknown product " + reaction.product;
+        if(find_definition(definitions, reaction.byproduct) < 0)
+            return "its reaction with " + reaction.agent + " has an unknown byproduct " + reaction.byproduct;
+        if(reaction.chance < 1 || reaction.chance > 100)
+            return "its reaction with " + reaction.agent + " needs a chance within 1 and 100";
+
+        for(std::size_t j = 0; j < i; ++j) {
+            if(definition.reactions[j].agent == reaction.agent)
+                return "it has two reactions with " + reaction.agent;
+        }
+    }
+    return "";
+}
+
+void MaterialRegistry::compile_interactions(const std::vector<MaterialDefinition>& definitions) {
+    for(std::array<bool, 256>& row: displacements_)
+        row.fill(false);
+    for(std::array<std::uint8_t, 256>& row: reaction_indices_)
+        row.fill(0);
+    reactions_.assign(1, Reaction());
+
+    for(int material = 1; material < count_; ++material) {
+        // Powders sink into the liquids that are lighter than them.
+        if(phases_[material] == Phase::POWDER) {
+            for(int neighbor = 1; neighbor < count_; ++neighbor) {
+                displacements_[material][neighbor] = phases_[neighbor] == Phase::LIQUID &&
+                                                     densities_[neighbor] < densities_[material];
+            }
+        }
+
+        for(const ReactionDefinition& definition: definitions[material - 1].reactions) {
+            Reaction reaction;
+            reaction.product   = MaterialId(find_definition(definitions, definition.product));
+            reaction.byproduct = MaterialId(find_definition(definitions, definition.byproduct));
+            reaction.chance    = definition.chance;
+
+            reaction_indices_[find_definition(definitions, definition.agent)][material] = std::uint8_t(reactions_.size());
+            reactions_.push_back(reaction);
+        }
+    }
+}
+
+bool MaterialRegistry::define(const std::vector<MaterialDefinition>& definitions) {
+    if(definitions.empty()) {
+        std::cerr << "There are no materials\n";
+        return false;
+    }
+    if(int(definitions.size()) >= MAX_COUNT) {
+        std::cerr << "There are " << definitions.size() << " materials, the palette has room for "
+                  << MAX_COUNT - 1 << '\n';
+        return false;
+    }
+
+    // The reaction matrix stores the index of a reaction in a byte.
+    std::size_t reaction_count = 0;
+    for(const MaterialDefinition& definition: definitions)
+        reaction_count += definition.reactions.size();
+    if(reaction_count > UINT8_MAX) {
+        std::cerr << "There are " << reaction_count << " reactions, the limit is " << UINT8_MAX << '\n';
+        return false;
+    }
+
+    for(std::size_t i = 0; i < definitions.size(); ++i) {
+        const MaterialDefinition& definition = definitions[i];
+        std::string error = check(definition, definitions);
+
+        for(std::size_t j = 0; j < i && error.empty(); ++j) {
+            if(definitions[j].name == definition.name)
+                error = "the name is used twice";
+        }
+        if(!error.empty()) {
+            std::cerr << "Invalid material " << definition.name << ": " << error << '\n';
+            return false;
+        }
+    }
+
+    count_ = int(definitions.size()) + 1;
+    names_.fill("Empty");
+    phases_.fill(Phase::NONE);
+    falls_.fill(false);
+    falling_materials_.clear();
+    densities_.fill(0);
+    dispersion_rates_.fill(0);
+    spread_chances_.fill(0);
+    initial_states_.fill(ParticleState());
+    movements_.assign(count_, MovementTable());
+    palette_.fill(Color3(0.0f, 0.0f, 0.0f));
+
+    for(int material = 1; material < count_; ++material) {
+        const MaterialDefinition& definition = definitions[material - 1];
+        const bool has_lifetime = definition.phase == Phase::GAS || definition.phase == Phase::PLASMA;
+
+        names_[material]            = definition.name;
+        phases_[material]           = definition.phase;
+        falls_[material]            = definition.phase == Phase::POWDER || definition.phase == Phase::LIQUID;
+        densities_[material]        = definition.density;
+        dispersion_rates_[material] = definition.dispersion_rate;
+        spread_chances_[material]   = definition.spread_chance;
+
+        if(falls_[material])
+            falling_materials_.push_back(MaterialId(material));
+        if(has_lifetime)
+            initial_states_[material].lifetime = std::int16_t(definition.lifetime);
+        if(definition.phase == Phase::PLASMA)
+            initial_states_[material].ignition_delay = std::uint8_t(definition.ignition_delay);
+
+        if(!definition.movement.empty()) {
+            const DirectionWeight* weights = definition.movement.data();
+            movements_[material] = MovementTable(weights, weights + definition.movement.size());
+        }
+
+        for(int shade = 0; shade < PALETTE_SHADES; ++shade) {
+            const float t = shade / float(PALETTE_SHADES - 1);
+            palette_[material * PALETTE_SHADES + shade] = definition.color_from * (1.0f - t) + definition.color_to * t;
+        }
+    }
+
+    compile_interactions(definitions);
+    compute_fingerprint(definitions);
+    return true;
+}
+
+void MaterialRegistry::compute_fingerprint(const std::vector<MaterialDefinition>& definitions) {
+    std::uint64_t fingerprint = 0;
+    add_to_fingerprint(fingerprint, std::uint64_t(count_));
+
+    for(int material = 1; material < count_; ++material) {
+        const MaterialDefinition& definition = definitions[material - 1];
+        add_to_fingerprint(fingerprint, names_[material]);
+        add_to_fingerprint(fingerprint, std::uint64_t(phases_[material]));
+        add_to_fingerprint(fingerprint, std::uint64_t(densities_[material]));
+        add_to_fingerprint(fingerprint, std::uint64_t(dispersion_rates_[material]));
+        add_to_fingerprint(fingerprint, std::uint64_t(spread_chances_[material]));
+        add_to_fingerprint(fingerprint, std::uint64_t(initial_states_[material].lifetime));
+        add_to_fingerprint(fingerprint, std::uint64_t(initial_states_[material].ignition_delay));
+
+        add_to_fingerprint(fingerprint, definition.movement.size());
+        for(const DirectionWeight& weight: definition.movement) {
+            add_to_fingerprint(fingerprint, std::uint64_t(weight.direction));
+            add_to_fingerprint(fingerprint, std::uint64_t(weight.weight));
+        }
+
+        add_to_fingerprint(fingerprint, definition.reactions.size());
+        for(const ReactionDefinition& reaction: definition.reactions) {
+            add_to_fingerprint(fingerprint, reaction.agent);
+            add_to_fingerprint(fingerprint, reaction.product);
+            add_to_fingerprint(fingerprint, reaction.byproduct);
+            add_to_fingerprint(fingerprint, std::uint64_t(reaction.chance));
+        }
+    }
+    fingerprint_ = fingerprint;
+}
+
+MaterialId MaterialRegistry::find(const std::string& name) const {
+    for(int material = 1; material < count_; ++material) {
+        if(names_[material] == name)
+            return MaterialId(material);
+    }
+    return ParticleType::EMPTY;
+}
+
+bool parse_materials(std::istream& stream, const std::string& source,
+                     std::vector<MaterialDefinition>& definitions) {
+    std::string header;
+    int version = 0;
+    if(!(stream >> header >> version) || header != MATERIALS_HEADER) {
+        std::cerr << "Not a material definition file: " << source << '\n';
+        return false;
+    }
+    if(version != MATERIALS_VERSION) {
+        std::cerr << "The material definitions are version " << version << ", this build reads version "
+                  << MATERIALS_VERSION << ": " << source << '\n';
+        return false;
+    }
+
+    std::vector<MaterialDefinition> parsed;
+    std::string line;
+    int line_number = 1;
+
+    std::getline(stream, line);
+    while(std::getline(stream, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream line_stream(line);
+        std::string key;
+        if(!(line_stream >> key))
+            continue;
+
+        bool is_valid = true;
+        if(key == "material") {
+            MaterialDefinition definition;
+            is_valid = bool(std::getline(line_stream >> std::ws, definition.name));
+
+            // The trailing spaces aren't part of the name.
+            definition.name.erase(definition.name.find_last_not_of(" \t\r") + 1);
+            parsed.push_back(definition);
+        }
+        else if(parsed.empty()) {
+            // Every property belongs to the material above it.
+            is_valid = false;
+        }
+        else {
+            MaterialDefinition& definition = parsed.back();
+
+            if(key == "phase") {
+                std::string phase;
+                is_valid = bool(line_stream >> phase) && parse_phase(phase, definition.phase);
+            }
+            else if(key == "density") {
+                is_valid = bool(line_stream >> definition.density);
+            }
+            else if(key == "dispersion") {
+                is_valid = bool(line_stream >> definition.dispersion_rate);
+            }
+            else if(key == "lifetime") {
+                is_valid = bool(line_stream >> definition.lifetime);
+            }
+            else if(key == "ignition_delay") {
+                is_valid = bool(line_stream >> definition.ignition_delay);
+            }
+            else if(key == "spread") {
+                is_valid = bool(line_stream >> definition.spread_chance);
+            }
+            else if(key == "color") {
+                Color3& from = definition.color_from;
+                Color3& to   = definition.color_to;
+                is_valid = bool(line_stream >> from.r >> from.g >> from.b >> to.r >> to.g >> to.b);
+            }
+            else if(key == "reaction") {
+                ReactionDefinition reaction;
+                is_valid = bool(line_stream >> reaction.agent >> reaction.product >> reaction.byproduct);
+
+                // The chance is optional.
+                if(is_valid && !(line_stream >> reaction.chance)) {
+                    is_valid = line_stream.eof();
+                    reaction.chance = 100;
+                }
+                definition.reactions.push_back(reaction);
+            }
+            else if(key == "movement") {
+                definition.movement.clear();
+
+                std::string direction;
+                while(is_valid && line_stream >> direction) {
+                    DirectionWeight weight;
+                    is_valid = parse_direction(direction, weight.direction) && bool(line_stream >> weight.weight);
+                    definition.movement.push_back(weight);
+                }
+                is_valid = is_valid && !definition.movement.empty();
+            }
+            else {
+                is_valid = false;
+            }
+        }
+
+        // Nothing can follow the values.
+        std::string rest;
+        if(!is_valid || line_stream >> rest) {
+            std::cerr << "Invalid line " << line_number << " in the material definitions: " << source << '\n';
+            return false;
+        }
+    }
+
+    definitions = std::move(parsed);
+    return true;
+}
+
+bool load_materials(const std::string& path) {
+    std::ifstream file(path);
+    if(!file) {
+        std::cerr << "Couldn't open the material definitions: " << path << '\n';
+        return false;
+    }
+
+    std::vector<MaterialDefinition> definitions;
+    return parse_materials(file, path, definitions) && material_registry().define(definitions);
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "grid.hpp"
+#include "random.hpp"
+
+using Color3 = glm::vec3;
+
+// Every color a cell can have is an entry of a palette of 256 colors. The
+// upper bits of the index are the material and the lower bits its shade,
+// so a whole grid can be drawn from one byte per cell.
+inline const int PALETTE_SIZE   = 256;
+inline const int PALETTE_SHADES = 8;
+
+// The path of the definition file loaded at startup, relative to the
+// working directory like the shaders.
+inline const char* MATERIALS_PATH = "./materials.txt";
+
+// The rules a material follows, see particle.cpp.
+enum class Phase: std::uint8_t {
+    NONE,   // The empty cells and the border, which have no rules.
+    POWDER, // Falls, piles up and sinks into lighter liquids.
+    LIQUID, // Falls and spreads out horizontally.
+    SOLID,  // Never moves.
+    GAS,    // Rises along its movement weights until its lifetime runs out.
+    PLASMA  // Burns in place, spreads upwards and ignites its neighbors.
+};
+
+// A conversion of a material when a particle of another material, the
+// agent, reacts with it. The names refer to other materials, and "none"
+// stands for the empty cell.
+struct ReactionDefinition {
+public:
+    std::string agent;
+
+    // The material the cell turns into, and the one placed
+    // above the cell when it is empty.
+    std::string product;
+    std::string byproduct;
+
+    // The percent chance that the reaction happens when the agent tries.
+    int chance = 100;
+};
+
+// A reaction compiled into material IDs.
+struct Reaction {
+public:
+    MaterialId product   = 0;
+    MaterialId byproduct = 0;
+    int chance           = 100;
+};
+
+// The state a cell starts with when a particle is inserted into it.
+struct ParticleState {
+    std::int16_t lifetime       = 0;
+    std::uint8_t ignition_delay = 0;
+};
+
+// A material as written in the definition file.
+struct MaterialDefinition {
+public:
+    std::string name;
+    Phase phase = Phase::NONE;
+
+    // Powders only sink into liquids of a lower density.
+    int density = 0;
+
+    // The number of cells the columns of a body of liquid can sink
+    // per tick while it levels out, see LiquidLeveler, and that a
+    // particle under a ceiling can move sideways per tick.
+    int dispersion_rate = 0;
+
+    // The number of ticks before a gas or a plasma disappears.
+    int lifetime = 0;
+
+    // The number of ticks between the attempts of a plasma to ignite
+    // its neighbors, and the percent chance it spreads at every attempt.
+    int ignition_delay = 0;
+    int spread_chance  = 0;
+
+    // The colors of the darkest and the brightest shade. The shades of a
+    // plasma go from the first to the second as it burns out.
+    Color3 color_from = Color3(0.0f, 0.0f, 0.0f);
+    Color3 color_to   = Color3(0.0f, 0.0f, 0.0f);
+
+    // The odds of a gas moving in each direction.
+    std::vector<DirectionWeight> movement;
+
+    // How the material converts when the agents react with it. Only the
+    // plasmas react with their neighbors, while they try to ignite them.
+    std::vector<ReactionDefinition> reactions;
+};
+
+// The materials of the simulation. The material IDs follow the order of the
+// definitions, starting at 1 since 0 is the empty cell. The definitions are
+// compiled into dense tables indexed by the material ID, which is what the
+// rules read while updating the cells.
+//
+// How two materials interact is compiled into two matrices indexed by the
+// material that is updated and the material of its neighbor, which can be
+// any ID including the border. Displacement tells whether a particle can
+// swap places with its neighbor, which only depends on their phases and
+// densities. Conversions are the reactions, which change the neighbor into
+// other materials. Checking a neighbor is a single load either way.
+class MaterialRegistry {
+public:
+    // The number of materials, the empty cell included, that the palette
+    // has room for.
+    static constexpr int MAX_COUNT = PALETTE_SIZE / PALETTE_SHADES;
+
+    // The largest dispersion rate, so a body of liquid doesn't level
+    // out much faster than its particles fall.
+    static constexpr int MAX_DISPERSION_RATE = CHUNK_SIZE / 2 - 1;
+
+    // The largest total of the movement weights of a material, which
+    // MovementTable multiplies by its size.
+    static constexpr int MAX_MOVEMENT_WEIGHT = 1 << 16;
+
+    // Starts with the default materials, see ParticleType.
+    MaterialRegistry();
+
+    // Replaces the materials with the definitions. Returns false and keeps
+    // the materials when a definition is invalid. This must not be called
+    // while a world is being simulated or drawn.
+    bool define(const std::vector<MaterialDefinition>& definitions);
+
+    // Returns the number of material IDs in use, the empty cell included.
+    int get_count() const { return count_; }
+
+    // Returns the ID of the material with the name, or EMPTY when there's none.
+    MaterialId find(const std::string& name) const;
+
+    // Returns a hash of everything the rules read, the colors aside. The
+    // files that store particles keep it, since they only play the same
+    // with the same materials.
+    std::uint64_t get_fingerprint() const { return fingerprint_; }
+
+    const std::string& name_of(const MaterialId material) const { return names_[material]; }
+    Phase phase_of(const MaterialId material)             const { return phases_[material]; }
+    int density_of(const MaterialId material)             const { return densities_[material]; }
+    int dispersion_rate_of(const MaterialId material)     const { return dispersion_rates_[material]; }
+    int lifetime_of(const MaterialId material)            const { return initial_states_[material].lifetime; }
+    int spread_chance_of(const MaterialId material)       const { return spread_chances_[material]; }
+
+    // Gases and plasmas store the tick they die at instead of counting
+    // down, and plasmas the tick they next ignite their neighbors at. They
+    // sleep until then when they have nothing else to do, see Grid::wake_at.
+    bool has_deadlines(const MaterialId material) const {
+        return phases_[material] == Phase::GAS || phases_[material] == Phase::PLASMA;
+    }
+
+    // Powders and liquids fall straight down into empty cells.
+    bool falls(const MaterialId material) const { return falls_[material]; }
+    const std::vector<MaterialId>& get_falling_materials() const { return falling_materials_; }
+
+    const ParticleState& initial_state_of(const MaterialId material) const {
+        return initial_states_[material];
+    }
+    const MovementTable& movement_of(const MaterialId material) const {
+        return movements_[material];
+    }
+
+    // Returns true when a particle of the material sinks into its
+    // neighbor, which is a lighter liquid below a powder.
+    bool displaces(const MaterialId material, const MaterialId neighbor) const {
+        return displacements_[material][neighbor];
+    }
+
+    // Returns the index of the reaction of the neighbor with the agent,
+    // or 0 when they don't react.
+    int reaction_index_of(const MaterialId agent, const MaterialId neighbor) const {
+        return reaction_indices_[agent][neighbor];
+    }
+    const Reaction& get_reaction(const int index) const { return reactions_[index]; }
+
+    // Returns the color of every palette index.
+    const std::array<Color3, PALETTE_SIZE>& get_palette() const { return palette_; }
+
+private:
+    // Returns an empty string when the definition is valid, or what's
+    // wrong with it. The reactions refer to the other definitions.
+    static std::string check(const MaterialDefinition& definition,
+                             const std::vector<MaterialDefinition>& definitions);
+
+    // Fills the displacement and reaction matrices of the definitions.
+    void compile_interactions(const std::vector<MaterialDefinition>& definitions);
+
+    // Hashes the compiled tables and the definitions into the fingerprint.
+    void compute_fingerprint(const std::vector<MaterialDefinition>& definitions);
+
+private:
+    int count_ = 1;
+    std::uint64_t fingerprint_ = 0;
+
+    std::array<std::string, 256>   names_;
+    std::array<Phase, 256>         phases_;
+    std::array<bool, 256>          falls_;
+    std::vector<MaterialId>        falling_materials_;
+    std::array<int, 256>           densities_;
+    std::array<int, 256>           dispersion_rates_;
+    std::array<int, 256>           spread_chances_;
+    std::array<ParticleState, 256> initial_states_;
+    std::vector<MovementTable>     movements_;
+
+    // The rows are the materials updated, and the columns their neighbors.
+    std::array<std::array<bool, 256>, MAX_COUNT>         displacements_;
+    std::array<std::array<std::uint8_t, 256>, MAX_COUNT> reaction_indices_;
+    std::vector<Reaction> reactions_; // The first one is unused.
+
+    std::array<Color3, PALETTE_SIZE> palette_;
+};
+
+// The materials used by every world.
+inline MaterialRegistry& material_registry() {
+    static MaterialRegistry registry;
+    return registry;
+}
+
+// Reads the definitions of a definition file. The file starts with the
+// line "crumble-materials 1" and every material starts with a line
+// "material <name>" followed by one line per property, see materials.txt.
+// Returns false when the text isn't valid, the name of the source is used
+// in the error messages.
+bool parse_materials(std::istream& stream, const std::string& source,
+                     std::vector<MaterialDefinition>& definitions);
+
+// Replaces the materials of the registry with the ones of the file.
+// Returns false and keeps the materials when the file isn't valid.
+bool load_materials(const std::string& path);
@@ -1,380 +1,286 @@
+#include <algorithm>
+
 #include "particle.hpp"
 #include "particle_types.hpp"
 #include "random.hpp"
 
+// Returns the neighbor of the cell in the direction.
+static Cell neighbor_of(const Cell cell, const Direction direction) {
+    switch(direction) {
+        case Direction::UP:         return cell.up();
+        case Direction::DOWN:       return cell.down();
+        case Direction::LEFT:       return cell.left();
+        case Direction::RIGHT:      return cell.right();
+        case Direction::UP_RIGHT:   return cell.up_right();
+        case Direction::UP_LEFT:    return cell.up_left();
+        case Direction::DOWN_RIGHT: return cell.down_right();
+        case Direction::DOWN_LEFT:  return cell.down_left();
+        default:                    return cell;
+    }
+}
 
 //------------------------------
-// Sand Particle
+// Powders
 //------------------------------
-const std::string SandParticle::name = "Sand";
-
-void SandParticle::update(const int i, const int j, Grid& grid) {
+static void update_powder(const MaterialRegistry& materials, const int i, const int j, Grid& grid) {
+    const MaterialId material = grid.unchecked_at(i, j);
     Cell cell(i, j);
 
-    if(j > 0 && grid.is_cell_empty(cell.down())) {
+    if(grid.is_cell_empty(cell.down())) {
         grid.swap(cell, cell.down());
     }
-    else if(j > 0 && i > 0 && grid.is_cell_empty(cell.down_left())) {
+    else if(grid.is_cell_empty(cell.down_left())) {
         grid.swap(cell, cell.down_left());
     }
-    else if(j > 0 && i < COLUMNS-1 && grid.is_cell_empty(cell.down_right())) {
+    else if(grid.is_cell_empty(cell.down_right())) {
         grid.swap(cell, cell.down_right());
     }
 
     constexpr int MOVE_LEFT = 0;
-    const int MOVEMENT_DIRECTION = gen_random_num(0, 1);
+    const int MOVEMENT_DIRECTION = gen_random_bool();
+    const bool can_sink_left  = materials.displaces(material, grid.unchecked_at(cell.down_left()));
+    const bool can_sink_right = materials.displaces(material, grid.unchecked_at(cell.down_right()));
 
     if(MOVEMENT_DIRECTION == MOVE_LEFT) {
-        if(j > 0 && i > 0 && !grid.is_cell_empty(cell.down_left()) && grid.at(cell.down_left())->is_affected_by(ParticleType::SAND)) {
+        if(can_sink_left) {
             grid.swap(cell, cell.down_left());
         }
     }
     // Move right.
     else {
-        if(j > 0 && i < COLUMNS-1 && !grid.is_cell_empty(cell.down_right()) && grid.at(cell.down_right())->is_affected_by(ParticleType::SAND)) {
+        if(can_sink_right) {
             grid.swap(cell, cell.down_right());
         }
     }
-}
-
-bool SandParticle::is_affected_by(const int particle_id) const {
-    return false;
-}
 
-void SandParticle::interact_with(const int particle_id, Cell cell, Grid& grid) const {
-    switch(particle_id) {
-        default: {
-        }
+    // The side is picked at random, so a powder that can sink must
+    // stay awake until it picks a side that it can sink into.
+    if(can_sink_left || can_sink_right) {
+        grid.keep_awake(cell);
     }
 }
 
-Color3 SandParticle::get_color() const {
-    return Color3(0.79f, 0.74f, 0.58f); 
-}
-
 //------------------------------
-// Water Particle
+// Liquids
 //------------------------------
-const std::string WaterParticle::name = "Water";
 
-void WaterParticle::update(const int i, const int j, Grid& grid) {
+// A liquid falls like a powder. A particle that can't fall any further
+// and has nothing above it asks for its body of liquid to be leveled at
+// the end of the tick, see LiquidLeveler, which moves the particles
+// sideways. The leveler only moves the particles down, so a particle
+// under a ceiling, like in a tunnel or under an overhang, spreads on its
+// own by up to the dispersion rate of the liquid instead. The particles
+// under the surface have nothing to do.
+static void update_liquid(const MaterialRegistry& materials, const int i, const int j, Grid& grid) {
     Cell curr_cell(i, j);
 
-    constexpr int MOVE_RIGHT = 1;
-    const int MOVE_DIRECTION = gen_random_num(0, MOVE_RIGHT);
-
     // Move particle down one block if nothing is there
-    if(j > 0 && grid.is_cell_empty(curr_cell.down())) {
+    if(grid.is_cell_empty(curr_cell.down())) {
         grid.swap(curr_cell, curr_cell.down());
     }
     // Move particle down and left by one block if nothing is there
-    else if(i > 0 && j > 0 && grid.is_cell_empty(curr_cell.down_left())) {
+    else if(grid.is_cell_empty(curr_cell.down_left())) {
         grid.swap(curr_cell, curr_cell.down_left());
     }
     // Move particle down and right by one block if nothing is there
-    else if(i < ROWS-1 && j > 0 && grid.is_cell_empty(curr_cell.down_right())) {
+    else if(grid.is_cell_empty(curr_cell.down_right())) {
         grid.swap(curr_cell, curr_cell.down_right());
     }
-    // Move particle left if nothing is there
-    else if(i-get_dispersion_rate() > 0 && MOVE_DIRECTION != MOVE_RIGHT) {
-        grid.move_cell_left_until_blocked(Cell(i, j), get_dispersion_rate());
+    else if(grid.is_cell_empty(curr_cell.up())) {
+        grid.request_leveling(curr_cell);
     }
-    // Move particle right if nothing is there
-    else if(i+get_dispersion_rate() < ROWS && MOVE_DIRECTION == MOVE_RIGHT) {
-        grid.move_cell_right_until_blocked(Cell(i, j), get_dispersion_rate());
-    }
-}
+    else if(grid.is_cell_empty(curr_cell.left()) || grid.is_cell_empty(curr_cell.right())) {
+        // The direction is picked at random, so a liquid that has room to
+        // spread must stay awake even when it can't move this tick.
+        grid.keep_awake(curr_cell);
 
-bool WaterParticle::is_affected_by(const int particle_id) const {
-    switch(particle_id) {
-        case ParticleType::FIRE: {
-            return true;
-        }
-        // Temporary until I figure out how
-        // to distinguish the difference between a particle interaction
-        // that affects movement vs something that is a conversion.
-        case ParticleType::SAND: {
-            return true;
-        }
-        default: {
-            return false;
-        }
+        const int dispersion_rate = materials.dispersion_rate_of(grid.unchecked_at(curr_cell));
+        if(gen_random_bool())
+            grid.move_cell_right_until_blocked(curr_cell, dispersion_rate);
+        else
+            grid.move_cell_left_until_blocked(curr_cell, dispersion_rate);
     }
 }
 
-void WaterParticle::interact_with(const int particle_id, Cell cell, Grid& grid) const {
-    switch(particle_id) {
-        case ParticleType::FIRE: {
-            delete grid.at(cell);
-            Particle* particle = new SteamParticle();
-            grid.at(cell) = particle;
-            break;
-        }
-        default: {
-
-        }
-    }
-}
-
-Color3 WaterParticle::get_color() const {
-    return Color3(0.0f, 0.0f, 1.0f);
-}
-
-int WaterParticle::get_dispersion_rate() const {
-    return 5;
-}
-
 //------------------------------
-// Wall Particle
+// Gases
 //------------------------------
-const std::string WallParticle::name = "Wall";
-
-void WallParticle::update(const int i, const int j, Grid& grid) {
-    // The WallParticle doesn't move.
-}
-
-bool WallParticle::is_affected_by(const int particle_id) const {
-    return false;
+// Returns the number of ticks left before the gas or the plasma dies,
+// which is 0 or less once it should. The cell stores the lower 16 bits
+// of the deadline.
+static int lifetime_left(const Grid& grid, const Cell cell) {
+    return std::int16_t(std::uint16_t(grid.lifetime(cell)) - std::uint16_t(grid.get_tick()));
 }
 
-void WallParticle::interact_with(const int particle_id, Cell cell, Grid& grid) const {
-    switch(particle_id) {
-        default: {
+// Returns true when the gas has no empty cell to move into.
+static bool is_trapped(const MovementTable& movement, const Cell cell, const Grid& grid) {
+    if(grid.is_cell_empty(cell.left()) || grid.is_cell_empty(cell.right()))
+        return false;
 
-        }
+    for(int direction = 0; direction < 8; ++direction) {
+        if(movement.can_draw(Direction(direction)) && grid.is_cell_empty(neighbor_of(cell, Direction(direction))))
+            return false;
     }
+    return true;
 }
 
-Color3 WallParticle::get_color() const {
-    //return Color3(0.1f, 0.1f, 0.1f); 
-    return Color3(1.0f, 1.0f, 1.0f); 
-}
-
-//------------------------------
-// Smoke Particle
-//------------------------------
-const std::string SmokeParticle::name = "Smoke";
-
-void SmokeParticle::update(const int i, const int j, Grid& grid) {
+// A gas that can't move anywhere, like the gas piled up under a ceiling,
+// sleeps until it dies instead of drawing directions every tick. The cells
+// that move next to it wake it earlier.
+static void update_gas(const MaterialRegistry& materials, const int i, const int j, Grid& grid) {
+    const MaterialId material = grid.unchecked_at(i, j);
     Cell curr_cell(i, j);
-    m_lifetime_left--;
 
-    if(m_lifetime_left <= 0) {
-        grid.remove(curr_cell.x, curr_cell.y);
+    const int ticks_until_death = lifetime_left(grid, curr_cell);
+    if(ticks_until_death <= 0) {
+        grid.remove(i, j);
         return;
     }
 
-    const Direction direction = gen_random_weighted_vertical_direction(80, 10, 10);
+    const MovementTable& movement = materials.movement_of(material);
+    const Cell target = neighbor_of(curr_cell, movement.sample());
 
-    if(j < COLUMNS-1 && grid.is_cell_empty(curr_cell.up()) && direction == Direction::UP) {
-        grid.swap(curr_cell, curr_cell.up());
-    }
-    else if(i > 0 && j < COLUMNS-1 && grid.is_cell_empty(curr_cell.up_left()) && direction == Direction::UP_LEFT) {
-        grid.swap(curr_cell, curr_cell.up_left());
-    }
-    else if(i < ROWS-1 && j < COLUMNS-1 && grid.is_cell_empty(curr_cell.up_right()) && direction == Direction::UP_RIGHT) {
-        grid.swap(curr_cell, curr_cell.up_right());
+    if(grid.is_cell_empty(target)) {
+        grid.swap(curr_cell, target);
     }
-    else if(i > 0 && grid.is_cell_empty(curr_cell.left())) {
+    else if(grid.is_cell_empty(curr_cell.left())) {
         grid.swap(curr_cell, curr_cell.left());
     }
-    else if(i < ROWS-1 && grid.is_cell_empty(curr_cell.right())) {
+    else if(grid.is_cell_empty(curr_cell.right())) {
         grid.swap(curr_cell, curr_cell.right());
     }
-}
-
-bool SmokeParticle::is_affected_by(const int particle_id) const {
-    return false;
-}
-
-void SmokeParticle::interact_with(const int particle_id, Cell cell, Grid& grid) const {
-    switch(particle_id) {
-        default: {
-
-        }
+    else if(is_trapped(movement, curr_cell, grid)) {
+        grid.wake_at(curr_cell, grid.get_tick() + ticks_until_death);
+    }
+    else {
+        grid.keep_awake(curr_cell);
     }
-}
-
-Color3 SmokeParticle::get_color() const {
-    return Color3(0.4f, 0.4f, 0.4f); 
 }
 
 //------------------------------
-// Wood Particle
+// Plasmas
 //------------------------------
-const std::string WoodParticle::name = "Wood";
 
-void WoodParticle::update(const int i, const int j, Grid& grid) {
-    // The WoodParticle doesn't move.
-}
+// Converts the cell into the products of the reaction.
+static void react(const Reaction& reaction, const Cell cell, Grid& grid) {
+    // The attempt is spent even when the reaction doesn't happen.
+    if(reaction.chance < 100 && gen_random_num(1, 100) > reaction.chance)
+        return;
 
-bool WoodParticle::is_affected_by(const int particle_id) const {
-    switch(particle_id) {
-        case ParticleType::FIRE: {
-            return true;
-        }
-        default: {
-            return false;
-        }
+    grid.convert(cell, reaction.product);
+
+    if(reaction.byproduct != ParticleType::EMPTY && grid.is_cell_empty(cell.up())) {
+        grid.insert(cell.up(), reaction.byproduct);
     }
 }
 
-void WoodParticle::interact_with(const int particle_id, Cell cell, Grid& grid) const {
-    switch(particle_id) {
-        case ParticleType::FIRE: {
-            delete grid.at(cell);
-            Particle* particle = new FireParticle();
-            grid.at(cell) = particle;
-
-            if(grid.is_cell_empty(cell.up())) {
-                grid.at(cell.up()) = new SmokeParticle();
-            }
+// Converts the first neighbor that reacts with the plasma.
+static void ignite_surroundings(const MaterialRegistry& materials, const Cell cell, const MaterialId material, Grid& grid) {
+    const Cell neighbors[] = {
+        cell.up(), cell.down(), cell.left(), cell.right(),
+        cell.down_left(), cell.down_right(), cell.up_right(), cell.up_left()
+    };
+    for(const Cell neighbor: neighbors) {
+        const int reaction = materials.reaction_index_of(material, grid.unchecked_at(neighbor));
+        if(reaction != 0) {
+            react(materials.get_reaction(reaction), neighbor, grid);
             break;
         }
-        default: {
-
-        }
     }
 }
 
-Color3 WoodParticle::get_color() const {
-    return Color3(0.59f, 0.29f, 0.0f); 
-}
-
-//------------------------------
-// Fire Particle
-//------------------------------
-const std::string FireParticle::name = "Fire";
-
-void FireParticle::update(const int i, const int j, Grid& grid) {
+// A plasma only does something when one of its deadlines comes, so it
+// sleeps until the earliest instead of keeping its chunk awake. The burning
+// cells are then only updated every few ticks and the fuel around them not
+// at all, until the flames reach it.
+static void update_plasma(const MaterialRegistry& materials, const int i, const int j, Grid& grid) {
+    const MaterialId material = grid.unchecked_at(i, j);
+    const std::uint64_t tick = grid.get_tick();
     Cell curr_cell(i, j);
-    lifetime_left_--;
 
-    if(lifetime_left_ <= 0) {
-        delete grid.at(i, j);
-        grid.at(i, j) = NULL;
+    const int ticks_until_death = lifetime_left(grid, curr_cell);
+    if(ticks_until_death <= 0) {
+        grid.remove(i, j);
         return;
     }
 
-    int flame_expansion_chance = gen_random_num(1, 100);
-    constexpr int THRESHOLD = 90;
+    // The cell stores the lower 8 bits of the tick of the next ignition.
+    // Like the lifetime, the difference is signed, so a plasma that wasn't
+    // updated at that tick ignites late instead of a wrap later.
+    std::uint8_t& next_ignition = grid.ignition_delay(curr_cell);
+    int ticks_until_ignition = std::int8_t(std::uint8_t(next_ignition - std::uint8_t(tick)));
 
-    if(flame_expansion_chance > THRESHOLD) {
-        if(j < COLUMNS-1 && i < ROWS-1 && grid.is_cell_empty(curr_cell.up_right())) {
-            grid.at(i + 1, j + 1) = new FireParticle();
-        }
-        else if(j < COLUMNS-1 && i > 0 && grid.is_cell_empty(curr_cell.up_left())) {
-            grid.at(i - 1, j + 1) = new FireParticle();
-        }
-    }
-
-    ignite_surroundings(curr_cell, grid);
-}
+    if(ticks_until_ignition <= 0) {
+        ticks_until_ignition = materials.initial_state_of(material).ignition_delay;
+        next_ignition = std::uint8_t(tick + ticks_until_ignition);
 
-bool FireParticle::is_affected_by(const int particle_id) const {
-    return false;
-}
-
-void FireParticle::interact_with(const int particle_id, Cell cell, Grid& grid) const {
-    switch(particle_id) {
-        default: {
+        const int flame_expansion_chance = gen_random_num(1, 100);
 
+        if(flame_expansion_chance > 100 - materials.spread_chance_of(material)) {
+            if(grid.is_cell_empty(curr_cell.up_right())) {
+                grid.insert(curr_cell.up_right(), material);
+            }
+            else if(grid.is_cell_empty(curr_cell.up_left())) {
+                grid.insert(curr_cell.up_left(), material);
+            }
         }
-    }
-}
-
-Color3 FireParticle::get_color() const {
-    if(lifetime_left_ <= 5)
-        return Color3(1.0f, 0.6f, 0.0f);
-    return Color3(1.00f, 0.0f, 0.0f); 
-}
-
-void FireParticle::set_spawn_on_death(Particle* particle) {
-    spawn_on_death_ = particle;
-}
 
-void FireParticle::ignite_surroundings(const Cell cell, Grid& grid) {
-    delay_until_inflamed_--;
-
-    if(delay_until_inflamed_ <= 0) {
-        delay_until_inflamed_ = 5;
-
-        if(cell.y < COLUMNS-1 && !grid.is_cell_empty(cell.up()) && grid.at(cell.up())->is_affected_by(ParticleType::FIRE)) {
-            grid.at(cell.up())->interact_with(ParticleType::FIRE, cell.up(), grid);
-        }
-        else if(cell.y > 0 && !grid.is_cell_empty(cell.down()) && grid.at(cell.down())->is_affected_by(ParticleType::FIRE)) {
-            grid.at(cell.down())->interact_with(ParticleType::FIRE, cell.down(), grid);
-        }
-        else if(cell.x > 0 && !grid.is_cell_empty(cell.left()) && grid.at(cell.left())->is_affected_by(ParticleType::FIRE)) {
-            grid.at(cell.left())->interact_with(ParticleType::FIRE, cell.left(), grid);
-        }
-        else if(cell.x < ROWS-1 && !grid.is_cell_empty(cell.right()) && grid.at(cell.right())->is_affected_by(ParticleType::FIRE)) {
-            grid.at(cell.right())->interact_with(ParticleType::FIRE, cell.right(), grid);
-        }
-        else if(cell.x > 0 && cell.y > 0 && !grid.is_cell_empty(cell.down_left()) && grid.at(cell.down_left())->is_affected_by(ParticleType::FIRE)) {
-            grid.at(cell.down_left())->interact_with(ParticleType::FIRE, cell.down_left(), grid);
-        }
-        else if(cell.x < ROWS-1 && cell.y > 0 && !grid.is_cell_empty(cell.down_right()) && grid.at(cell.down_right())->is_affected_by(ParticleType::FIRE)) {
-            grid.at(cell.down_right())->interact_with(ParticleType::FIRE, cell.down_right(), grid);
-        }
-        else if(cell.x < ROWS-1 && cell.y < COLUMNS-1 && !grid.is_cell_empty(cell.up_right()) && grid.at(cell.up_right())->is_affected_by(ParticleType::FIRE)) {
-            grid.at(cell.up_right())->interact_with(ParticleType::FIRE, cell.up_right(), grid);
-        }
-        else if(cell.x > 0 && cell.y < COLUMNS-1 && !grid.is_cell_empty(cell.up_left()) && grid.at(cell.up_left())->is_affected_by(ParticleType::FIRE)) {
-            grid.at(cell.up_left())->interact_with(ParticleType::FIRE, cell.up_left(), grid);
-        }
+        ignite_surroundings(materials, curr_cell, material, grid);
     }
+    grid.wake_at(curr_cell, tick + std::min(ticks_until_death, ticks_until_ignition));
 }
 
 //------------------------------
-// Steam Particle
+// Material Dispatch
 //------------------------------
-const std::string SteamParticle::name = "Steam";
+void update_particle(const int i, const int j, Grid& grid) {
+    const MaterialRegistry& materials = material_registry();
 
-void SteamParticle::update(const int i, const int j, Grid& grid) {
-    Cell curr_cell(i, j);
-    m_lifetime_left--;
-
-    if(m_lifetime_left <= 0) {
-        grid.remove(curr_cell.x, curr_cell.y);
-        return;
+    switch(materials.phase_of(grid.unchecked_at(i, j))) {
+        case Phase::POWDER: update_powder(materials, i, j, grid); break;
+        case Phase::LIQUID: update_liquid(materials, i, j, grid); break;
+        case Phase::GAS:    update_gas(materials, i, j, grid);    break;
+        case Phase::PLASMA: update_plasma(materials, i, j, grid); break;
+        default: break;
     }
+}
 
-    Direction direction = gen_random_weighted_vertical_direction(60, 20, 20);
+Color3 get_particle_color(const Grid& grid, const Cell cell) {
+    return get_palette()[get_palette_index(grid, cell)];
+}
 
-    if(j < COLUMNS-1 && grid.is_cell_empty(curr_cell.up()) && direction == Direction::UP) {
-        grid.swap(curr_cell, curr_cell.up());
-    }
-    else if(i > 0 && j < COLUMNS-1 && grid.is_cell_empty(curr_cell.up_left()) && direction == Direction::UP_LEFT) {
-        grid.swap(curr_cell, curr_cell.up_left());
-    }
-    else if(i < ROWS-1 && j < COLUMNS-1 && grid.is_cell_empty(curr_cell.up_right()) && direction == Direction::UP_RIGHT) {
-        grid.swap(curr_cell, curr_cell.up_right());
+std::uint8_t get_palette_index(const Grid& grid, const Cell cell) {
+    const MaterialRegistry& materials = material_registry();
+    const MaterialId material = grid.unchecked_at(cell);
+    int shade = 0;
+
+    if(material == ParticleType::EMPTY) {
     }
-    else if(i > 0 && grid.is_cell_empty(curr_cell.left())) {
-        grid.swap(curr_cell, curr_cell.left());
+    // A plasma takes its last shade once it is about to die out.
+    else if(materials.phase_of(material) == Phase::PLASMA) {
+        shade = lifetime_left(grid, cell) <= materials.lifetime_of(material) / 2 ? PALETTE_SHADES - 1 : 0;
     }
-    else if(i < ROWS-1 && grid.is_cell_empty(curr_cell.right())) {
-        grid.swap(curr_cell, curr_cell.right());
+    else {
+        shade = grid.color_seed(cell) / (256 / PALETTE_SHADES);
     }
+    return std::uint8_t(material * PALETTE_SHADES + shade);
 }
 
-bool SteamParticle::is_affected_by(const int particle_id) const {
-    return false;
+const std::array<Color3, PALETTE_SIZE>& get_palette() {
+    return material_registry().get_palette();
 }
 
-void SteamParticle::interact_with(const int particle_id, Cell cell, Grid& grid) const {
-    switch(particle_id) {
-        default: {
+ParticleState initial_state_of(const MaterialId material, const std::uint64_t tick) {
+    const MaterialRegistry& materials = material_registry();
+    ParticleState state = materials.initial_state_of(material);
 
-        }
-    }
+    if(materials.has_deadlines(material))
+        state.lifetime = std::int16_t(std::uint16_t(tick + state.lifetime));
+    if(materials.phase_of(material) == Phase::PLASMA)
+        state.ignition_delay = std::uint8_t(tick + state.ignition_delay);
+    return state;
 }
 
-Color3 SteamParticle::get_color() const {
-    return Color3(0.75f, 0.75f, 0.75f); 
+const std::string& name_of(const MaterialId material) {
+    return material_registry().name_of(material);
 }
-
-//------------------------------
-// Gas
-//------------------------------
@@ -10,158 +10,87 @@
 #include "particle_types.hpp"
 
 
-extern Grid GRID;
-extern const unsigned int COLUMNS;
-extern const unsigned int ROWS;
-
 int ParticleSystem::active_particle = ParticleType::SAND;
 int ParticleSystem::s_particle_size = 0;
-
-ParticleSystem::ParticleSystem(GLFWwindow* window) {
-    G_WORKER_THREAD = std::thread(plot_particles_in_grid, window);
+int ParticleSystem::s_update_mode   = int(UpdateMode::PARALLEL);
+int ParticleSystem::s_render_mode   = int(RenderMode::TEXTURE);
+int ParticleSystem::s_tick_rate     = 60;
+bool ParticleSystem::s_is_tick_rate_unlimited = false;
+int ParticleSystem::s_brush_shape   = int(BrushShape::SQUARE);
+
+ParticleSystem::ParticleSystem(GLFWwindow* window, SimulationThread& simulation_thread,
+                               const int grid_width, const int grid_height)
+    : window_(window), simulation_thread_(simulation_thread),
+      grid_width_(grid_width), grid_height_(grid_height),
+      texture_renderer_(grid_width, grid_height) {
+    if(InstanceRenderer::can_draw(grid_width, grid_height))
+        instance_renderer_ = std::make_unique<InstanceRenderer>(grid_width, grid_height);
+
+    // The input callbacks find the particle system through the window.
+    glfwSetWindowUserPointer(window, this);
 }
 
 ParticleSystem::~ParticleSystem() {
-    G_KEEP_THREAD_RUNNING = false;
-    G_WORKER_THREAD.join();
+    glfwSetWindowUserPointer(window_, nullptr);
 }
 
-void ParticleSystem::draw(unsigned int VAO, Shader& shader) {
-    glBindVertexArray(VAO);
-    shader.use();
-
-    int instance_count = 0;
-
-    // Render all the particles to the framebuffer.
-    for(int i = 0; i < ROWS; ++i) {
-        for(int j = 0; j < COLUMNS; ++j) {
-            if(GRID.at(i, j) != NULL && !GRID.at(i, j)->has_been_drawn) {
-                glm::mat4 model(1.0f);
-                GRID.at(i, j)->has_been_drawn = true;
-                glm::vec3 color = GRID.at(i, j)->get_color();
-                GRID.at(i, j)->update(i, j, GRID);
-
-                glm::vec3 translation = grid_to_ndc(i, j, ROWS, COLUMNS);
-                translations_[instance_count] = translation;
-                colors_[instance_count] = color;
-                ++instance_count;
-            }
-        }
+void ParticleSystem::draw(const Snapshot& snapshot) {
+    if(RenderMode(s_render_mode) == RenderMode::TEXTURE || !instance_renderer_) {
+        texture_renderer_.draw(snapshot);
     }
-    gen_instanced_arrays_of_size(instance_count);
-
-    if(instance_count > 0)
-        glDrawArraysInstanced(GL_POINTS, 0, 1, instance_count);
+    else {
+        instance_renderer_->draw(snapshot);
 
-    // Reset each particle's state so its only updated once per frame.
-    GRID.reset_has_been_drawn_flags();
-
-    glBindVertexArray(0);
+        // The texture misses the changes made while it isn't drawn.
+        texture_renderer_.invalidate();
+    }
 }
 
-void ParticleSystem::gen_instanced_arrays_of_size(int instance_count) {
-    unsigned int instance_vbos[2];
-    glGenBuffers(2, instance_vbos);
+void ParticleSystem::on_mouse_button(GLFWwindow* window, const int button, const int action) {
+    if(button != GLFW_MOUSE_BUTTON_LEFT)
+        return;
 
-    // The translations instanced array.
-    glBindBuffer(GL_ARRAY_BUFFER, instance_vbos[0]);
-    glBufferData(GL_ARRAY_BUFFER, instance_count * sizeof(glm::vec3),
-                 &translations_[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glVertexAttribDivisor(1, 1);
+    // Clicks on the menu don't paint.
+    if(action == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse) {
+        double xpos, ypos;
+        glfwGetCursorPos(window, &xpos, &ypos);
 
-    // The colors instanced array.
-    glBindBuffer(GL_ARRAY_BUFFER, instance_vbos[1]);
-    glBufferData(GL_ARRAY_BUFFER, instance_count * sizeof(glm::vec3),
-                 &colors_[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
-    glEnableVertexAttribArray(2);
-    glVertexAttribDivisor(2, 1);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+        is_painting_   = true;
+        previous_cell_ = cursor_to_cell(window, grid_width_, grid_height_, xpos, ypos);
+        paint_to(previous_cell_);
+    }
+    else if(action == GLFW_RELEASE) {
+        is_painting_ = false;
+    }
 }
 
-void plot_particles_in_grid(GLFWwindow* window) {
-    static double xpos, ypos;
-
-    while(G_KEEP_THREAD_RUNNING) {
-        if(G_DO_WORK_IN_THREAD) {
-            glfwGetCursorPos(window, &xpos, &ypos);
-            int amount_to_plot;
-            switch(ParticleSystem::s_particle_size) {
-                case Size::SIZE_ZERO:
-                    amount_to_plot = 1;  // 1x1
-                    break;
-                case Size::SIZE_ONE:
-                    amount_to_plot = 4;  // 2x2
-                    break;
-                case Size::SIZE_TWO:
-                    amount_to_plot = 16; // 4x4
-                    break;
-            }
-
-            Particle* particles[amount_to_plot];
-            switch(ParticleSystem::active_particle) {
-                int i;
-                case(ParticleType::WATER): {
-                    for(i = 0; i < amount_to_plot; ++i)
-                        particles[i] = new WaterParticle();
-                    break;
-                }
-                case(ParticleType::SAND): {
-                    for(i = 0; i < amount_to_plot; ++i)
-                        particles[i] = new SandParticle();
-                    break;
-                }
-                case(ParticleType::WALL): {
-                    for(i = 0; i < amount_to_plot; ++i)
-                        particles[i] = new WallParticle();
-                    break;
-                }
-                case(ParticleType::SMOKE): {
-                    for(i = 0; i < amount_to_plot; ++i)
-                        particles[i] = new SmokeParticle();
-                    break;
-                }
-                case(ParticleType::WOOD): {
-                    for(i = 0; i < amount_to_plot; ++i)
-                        particles[i] = new WoodParticle();
-                    break;
-                }
-                case(ParticleType::FIRE): {
-                    for(i = 0; i < amount_to_plot; ++i)
-                        particles[i] = new FireParticle();
-                    break;
-                }
-                case(ParticleType::STEAM): {
-                    for(i = 0; i < amount_to_plot; ++i)
-                        particles[i] = new SteamParticle();
-                    break;
-                }
-            }
-
-            int width, height;
-            glfwGetWindowSize(window, &width, &height);
-
-            // Sync cursor to where the particles render at. The particles
-            // will render offset from the cursor position without this.
-            double x_over_width = xpos / width, y_over_height = ypos / height;
-            int conversion_x = x_over_width * ROWS;
-            int conversion_y = y_over_height * COLUMNS;
-
-            // Flip the cursor's y-position such that it increases upwards.
-            // This is necessary because I like working with coordinate systems
-            // that have the origin in the bottom-left as opposed to the top-left.
-            plot(Cell(conversion_x, int(COLUMNS-conversion_y)), amount_to_plot, particles);
+void ParticleSystem::on_cursor_pos(GLFWwindow* window, const double xpos, const double ypos) {
+    if(is_painting_)
+        paint_to(cursor_to_cell(window, grid_width_, grid_height_, xpos, ypos));
+}
 
-            for(int i = 0; i < amount_to_plot; ++i)
-                particles[i] = nullptr;
-        }
+void ParticleSystem::paint_to(const Cell cell) {
+    BrushCommand command;
+    command.kind     = BrushKind::PAINT;
+    command.shape    = BrushShape(s_brush_shape);
+    command.material = MaterialId(active_particle);
+    command.x0 = previous_cell_.x;
+    command.y0 = previous_cell_.y;
+    command.x1 = cell.x;
+    command.y1 = cell.y;
+
+    switch(s_particle_size) {
+        case Size::SIZE_ZERO: command.size = 1; break;
+        case Size::SIZE_ONE:  command.size = 2; break;
+        case Size::SIZE_TWO:  command.size = 4; break;
     }
+
+    simulation_thread_.push_brush_command(command);
+    previous_cell_ = cell;
 }
 
-void display_particle_options_menu(double frame_time) {
+void display_particle_options_menu(double frame_time, SimulationThread& simulation_thread,
+                                   const Snapshot& snapshot) {
     ImGuiWindowFlags imgui_window_flags = 0;
     bool* p_open = NULL;
     imgui_window_flags |= ImGuiWindowFlags_NoMove;
@@ -177,36 +106,45 @@ void display_particle_options_menu(double frame_time) {
     else
         ImGui::Text("Mouse pos: <Invalid>");
     ImGui::Text("Mouse delta: (%g, %g)", io.MouseDelta.x, io.MouseDelta.y);
+    ImGui::Text("Tick: %llu (%d this frame)", (unsigned long long)snapshot.tick, snapshot.ticks);
+    ImGui::Text("Particles: %d", snapshot.particle_count);
+    ImGui::Text("Awake chunks: %d (%d occupied)", snapshot.awake_chunk_count, snapshot.occupied_chunk_count);
+    for(std::size_t material = ParticleType::EMPTY + 1; material < snapshot.material_counts.size(); ++material)
+        ImGui::Text("  %s: %d", name_of(MaterialId(material)).c_str(), snapshot.material_counts[material]);
 
     ImGui::RadioButton("Size 0", &ParticleSystem::s_particle_size, Size::SIZE_ZERO);
     ImGui::RadioButton("Size 1", &ParticleSystem::s_particle_size, Size::SIZE_ONE);
     ImGui::RadioButton("Size 2", &ParticleSystem::s_particle_size, Size::SIZE_TWO);
+    ImGui::RadioButton("Square", &ParticleSystem::s_brush_shape, int(BrushShape::SQUARE));
+    ImGui::RadioButton("Circle", &ParticleSystem::s_brush_shape, int(BrushShape::CIRCLE));
+    ImGui::NewLine();
+
+    ImGui::RadioButton("Serial",   &ParticleSystem::s_update_mode, int(UpdateMode::SERIAL));
+    ImGui::RadioButton("Parallel", &ParticleSystem::s_update_mode, int(UpdateMode::PARALLEL));
+    ImGui::RadioButton("Verify",   &ParticleSystem::s_update_mode, int(UpdateMode::VERIFY));
+    simulation_thread.set_update_mode(UpdateMode(ParticleSystem::s_update_mode));
+
+    ImGui::SliderInt("Tick rate", &ParticleSystem::s_tick_rate, 1, 480);
+    ImGui::Checkbox("Unlimited", &ParticleSystem::s_is_tick_rate_unlimited);
+    simulation_thread.set_tick_rate(ParticleSystem::s_is_tick_rate_unlimited ?
+                                    SimulationThread::UNLIMITED_TICK_RATE : ParticleSystem::s_tick_rate);
+    ImGui::NewLine();
+
+    // Larger grids are always drawn as a texture.
+    if(InstanceRenderer::can_draw(snapshot.width, snapshot.height))
+        ImGui::RadioButton("Instanced", &ParticleSystem::s_render_mode, int(RenderMode::INSTANCED));
+    ImGui::RadioButton("Texture",   &ParticleSystem::s_render_mode, int(RenderMode::TEXTURE));
     ImGui::NewLine();
     
-    ImGui::RadioButton(SandParticle::name.c_str(),
-                       &ParticleSystem::active_particle,
-                       ParticleType::SAND);
-    ImGui::RadioButton(WaterParticle::name.c_str(),
-                       &ParticleSystem::active_particle,
-                       ParticleType::WATER);
-    ImGui::RadioButton(WallParticle::name.c_str(),
-                       &ParticleSystem::active_particle,
-                       ParticleType::WALL);
-    ImGui::RadioButton(SmokeParticle::name.c_str(),
-                       &ParticleSystem::active_particle,
-                       ParticleType::SMOKE);
-    ImGui::RadioButton(WoodParticle::name.c_str(),
-                       &ParticleSystem::active_particle,
-                       ParticleType::WOOD);
-    ImGui::RadioButton(FireParticle::name.c_str(),
-                       &ParticleSystem::active_particle,
-                       ParticleType::FIRE);
-    ImGui::RadioButton(SteamParticle::name.c_str(),
-                       &ParticleSystem::active_particle,
-                       ParticleType::STEAM);
+    // One button per material of the registry.
+    for(int material = ParticleType::EMPTY + 1; material < material_registry().get_count(); ++material)
+        ImGui::RadioButton(name_of(MaterialId(material)).c_str(), &ParticleSystem::active_particle, material);
     ImGui::NewLine();
-    if(ImGui::Button("Clear"))
-        GRID.clear();
+    if(ImGui::Button("Clear")) {
+        BrushCommand command;
+        command.kind = BrushKind::CLEAR;
+        simulation_thread.push_brush_command(command);
+    }
 
     ImGui::End();
 }
@@ -216,54 +154,24 @@ void ParticleSystem::process_input(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     }
-}
-
-void plot(Cell cell, const int amount, Particle* particles[]) {
-    switch(amount) {
-        case 1:
-            plot_1x1(cell, particles[0]);
-            break;
-        case 4:
-            plot_2x2(cell, particles);
-            break;
-        case 16:
-            plot_4x4(cell, particles);
-            break;
-    }
-}
 
-void plot_1x1(Cell cell, Particle* particle) {
-    GRID.insert(cell, particle);
+    // Holding the button still keeps pouring particles.
+    if(is_painting_)
+        paint_to(previous_cell_);
 }
 
-void plot_2x2(Cell cell, Particle* particles[]) {
-    GRID.insert(cell,              particles[0]);
-    GRID.insert(cell.right(),      particles[1]);
-    GRID.insert(cell.down(),       particles[2]);
-    GRID.insert(cell.down_right(), particles[3]);
-}
-
-void plot_4x4(Cell cell, Particle* particles[]) {
-    // Top row
-    GRID.insert(cell,               particles[0]);
-    GRID.insert(cell.x + 1, cell.y, particles[1]);
-    GRID.insert(cell.x + 2, cell.y, particles[2]);
-    GRID.insert(cell.x + 3, cell.y, particles[3]);
-
-    // Middle rows
-    GRID.insert(cell.x,     cell.y - 1, particles[4]);
-    GRID.insert(cell.x + 1, cell.y - 1, particles[5]);
-    GRID.insert(cell.x + 2, cell.y - 1, particles[6]);
-    GRID.insert(cell.x + 3, cell.y - 1, particles[7]);
+Cell cursor_to_cell(GLFWwindow* window, const int grid_width, const int grid_height,
+                    const double xpos, const double ypos) {
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
 
-    GRID.insert(cell.x,     cell.y - 2, particles[8]);
-    GRID.insert(cell.x + 1, cell.y - 2, particles[9]);
-    GRID.insert(cell.x + 2, cell.y - 2, particles[10]);
-    GRID.insert(cell.x + 3, cell.y - 2, particles[11]);
+    // Sync cursor to where the particles render at. The particles
+    // will render offset from the cursor position without this.
+    const int x = int(xpos / width * grid_width);
+    const int y = int(ypos / height * grid_height);
 
-    // Bottom row
-    GRID.insert(cell.x,     cell.y - 3, particles[12]);
-    GRID.insert(cell.x + 1, cell.y - 3, particles[13]);
-    GRID.insert(cell.x + 2, cell.y - 3, particles[14]);
-    GRID.insert(cell.x + 3, cell.y - 3, particles[15]);
+    // Flip the cursor's y-position such that it increases upwards.
+    // This is necessary because I like working with coordinate systems
+    // that have the origin in the bottom-left as opposed to the top-left.
+    return Cell(x, grid_height - y);
 }
@@ -1,9 +1,6 @@
 #ifndef PARTICLE_SYSTEM_H
 #define PARTICLE_SYSTEM_H
 
-#include <csignal>
-#include <thread>
-
 #include "shader.hpp"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -13,35 +10,64 @@
 #include <imgui/backends/imgui_impl_glfw.h>
 #include <imgui/backends/imgui_impl_opengl3.h>
 
-#include "grid.hpp"
+#include <memory>
 
-inline bool        G_KEEP_THREAD_RUNNING = true;
-inline bool        G_DO_WORK_IN_THREAD = false;
-inline std::thread G_WORKER_THREAD;
+#include "brush.hpp"
+#include "grid.hpp"
+#include "instance_renderer.hpp"
+#include "simulation_thread.hpp"
+#include "texture_renderer.hpp"
+
+// How the particles are drawn.
+enum class RenderMode: int {
+    INSTANCED = 0, // A point per particle, see InstanceRenderer.
+    TEXTURE   = 1  // A texture of palette indices, see TextureRenderer.
+};
 
 // Manages the application's state, fills
 // the framebuffer, and inits the dependencies.
 class ParticleSystem {
 public:
-    ParticleSystem(GLFWwindow* window);
+    // The size of the grid is in cells.
+    ParticleSystem(GLFWwindow* window, SimulationThread& simulation_thread,
+                   const int grid_width, const int grid_height);
     ~ParticleSystem();
+    ParticleSystem(const ParticleSystem& other)            = delete;
+    ParticleSystem& operator=(const ParticleSystem& other) = delete;
 
-    void draw(const unsigned int VAO, Shader& shader);
+    // Draws the snapshot with the active RenderMode.
+    void draw(const Snapshot& snapshot);
     void process_input(GLFWwindow *window);
 
+    // Called by the GLFW callbacks of the window, see GlfwWrapper.
+    void on_mouse_button(GLFWwindow* window, const int button, const int action);
+    void on_cursor_pos(GLFWwindow* window, const double xpos, const double ypos);
+
 public:
     static int active_particle;
     static int s_particle_size;
+    static int s_update_mode;
+    static int s_render_mode;
+    static int s_tick_rate;
+    static bool s_is_tick_rate_unlimited;
+    static int s_brush_shape;
 
 private:
-    // Creates multiple instanced arrays with the size specified.
-    void gen_instanced_arrays_of_size(int instance_count);
+    // Paints a stroke from the previous position of the cursor to the cell.
+    void paint_to(const Cell cell);
 
 private:
-    // The size of this array is the max particle limit for the grid size
-    // 550 x 550. This buffer stores the translations for each particle.
-    glm::vec3 translations_[302500];
-    glm::vec3 colors_[302500];
+    GLFWwindow* window_;
+    SimulationThread& simulation_thread_;
+    int grid_width_, grid_height_;
+
+    // Null when the grid is too large to be drawn with instances,
+    // the texture is drawn instead.
+    std::unique_ptr<InstanceRenderer> instance_renderer_;
+    TextureRenderer texture_renderer_;
+
+    bool is_painting_ = false;
+    Cell previous_cell_{0, 0}; // Where the cursor was at the previous stroke.
 };
 
 //-------------------
@@ -50,17 +76,14 @@ private:
 
 // Displays a menu consisting of different particles types to render.
 //void display_particle_options_menu();
-void display_particle_options_menu(double frame_time);
-
+void display_particle_options_menu(double frame_time, SimulationThread& simulation_thread,
+                                   const Snapshot& snapshot);
 
-// This plots particles in the grid corresponding to the cursor's location
-// which are in screen coordinates [0, 0], is in the top-left whereas the
-// position [0, 0] in the grid corresponds to the bottom-left corner.
-void plot_particles_in_grid(GLFWwindow* window);
 
-void plot(Cell cell, const int amount, Particle* particles[]);
-void plot_1x1(Cell cell, Particle* particle);
-void plot_2x2(Cell cell, Particle* particles[]);
-void plot_4x4(Cell cell, Particle* particles[]);
+// Converts the cursor's position in screen coordinates, where [0, 0] is the
+// top-left, to the cell of the grid under it, where [0, 0] is the bottom-left.
+// The grid is stretched over the whole window.
+Cell cursor_to_cell(GLFWwindow* window, const int grid_width, const int grid_height,
+                    const double xpos, const double ypos);
 
 #endif
@@ -1,13 +1,21 @@
 #pragma once
 
+// The IDs of the default materials, in the order of materials.txt. The
+// benchmark scenarios refer to the materials by these.
 namespace ParticleType {
     enum Ptypes: int {
-        SAND  = 0,
-        WATER = 1,
-        WALL  = 2,
-        SMOKE = 3,
-        WOOD  = 4,
-        FIRE  = 5,
-        STEAM = 6
+        EMPTY = 0,
+        SAND  = 1,
+        WATER = 2,
+        WALL  = 3,
+        SMOKE = 4,
+        WOOD  = 5,
+        FIRE  = 6,
+        STEAM = 7,
+        COUNT,
+
+        // Fills the border around the grid. It never moves, reacts
+        // or gets drawn, it only stops the particles at the edges.
+        BORDER = 255
     };
 };
@@ -1,8 +1,11 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
 #include <iostream>
-#include <random>
-#include <unordered_map>
 
-enum class Direction {
+enum class Direction: std::int8_t {
     INVALID    = -1,
     UP         = 0, 
     DOWN       = 1, 
@@ -14,12 +17,108 @@ enum class Direction {
     DOWN_LEFT  = 7
 };
 
+// Mixes the bits of the value (the splitmix64 finalizer), so
+// consecutive inputs produce unrelated outputs.
+inline std::uint64_t mix_bits(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Combines the values into a well distributed seed, so seeds
+// derived from consecutive ticks or chunks are unrelated.
+inline std::uint64_t hash_seed(std::uint64_t a, std::uint64_t b, std::uint64_t c) {
+    return mix_bits(mix_bits(a + 0x9E3779B97F4A7C15ull * (b + 1)) + 0xBF58476D1CE4E5B9ull * (c + 1));
+}
+
+// A small and fast generator (splitmix64). Its whole state is one
+// integer, so reseeding it for every chunk of every tick is free.
+// This is not meant for anything but the simulation.
+class Random {
+public:
+    struct State {
+        std::uint64_t counter = 0;
+        std::uint64_t bits    = 0;
+        int bit_count         = 0;
+    };
+
+public:
+    explicit Random(const std::uint64_t seed = 0) {
+        this->seed(seed);
+    }
+
+    // Restarts the sequence of numbers.
+    void seed(const std::uint64_t seed) {
+        state_.counter   = seed;
+        state_.bits      = 0;
+        state_.bit_count = 0;
+    }
+
+    // Returns 64 random bits.
+    std::uint64_t next() {
+        state_.counter += 0x9E3779B97F4A7C15ull;
+        return mix_bits(state_.counter);
+    }
+
+    // Returns a number within [0, bound) with a multiply and a shift
+    // instead of a division. The bias is below bound / 2^32, which
+    // is negligible for the small ranges used by the particles.
+    std::uint32_t below(const std::uint32_t bound) {
+        return std::uint32_t(((next() >> 32) * bound) >> 32);
+    }
+
+    // Returns a number within the range [from, to].
+    int range(const int from, const int to) {
+        return from + int(below(std::uint32_t(to - from) + 1));
+    }
+
+    // Returns a number within [0, 2^count) for a count of at most 32. The
+    // bits are drawn 64 at a time and handed out in small batches, since
+    // most particles only need a coin flip or a few bits per update.
+    std::uint32_t draw_bits(const int count) {
+        if(state_.bit_count < count) {
+            state_.bits      = next();
+            state_.bit_count = 64;
+        }
+        const std::uint32_t bits = std::uint32_t(state_.bits & ((1ull << count) - 1));
+        state_.bits      >>= count;
+        state_.bit_count  -= count;
+        return bits;
+    }
+
+    // Returns true half of the time.
+    bool coin_flip() {
+        return draw_bits(1);
+    }
+
+    const State& get_state() const     { return state_; }
+    void set_state(const State& state) { state_ = state; }
+
+private:
+    State state_;
+};
+
+// Every thread draws from its own generator, so particles in different
+// chunks can be updated at the same time. The simulation reseeds it for
+// every chunk, which makes the particles reproducible from a seed.
+inline Random& thread_random() {
+    thread_local Random random;
+    return random;
+}
+
+// Restarts the sequence of numbers generated by the calling thread.
+inline void seed_random(const std::uint64_t seed) {
+    thread_random().seed(seed);
+}
+
 // Generates a random number within the range [from, to].
 inline int gen_random_num(int from, int to) {
-    std::random_device rand_device_seed;
-    static std::mt19937 rand_generator(rand_device_seed());
-    std::uniform_int_distribution<std::mt19937::result_type> distrib(from, to);
-    return distrib(rand_generator);
+    return thread_random().range(from, to);
+}
+
+// Returns true half of the time.
+inline bool gen_random_bool() {
+    return thread_random().coin_flip();
 }
 
 inline Direction gen_random_direction() {
@@ -28,36 +127,71 @@ inline Direction gen_random_direction() {
 }
 
 inline Direction gen_random_horizontal_direction() {
-    Direction random_direction = Direction::INVALID;
+    return gen_random_bool() ? Direction::LEFT : Direction::RIGHT;
+}
+
+// The odds of a material moving in each direction.
+struct DirectionWeight {
+    Direction direction;
+    int weight;
+};
 
-    // Discard directions that are not horizontal.
-    while(random_direction != Direction::LEFT || random_direction != Direction::RIGHT) {
-        random_direction = gen_random_direction();
+// A weighted distribution of directions that is built once, at compile time
+// when it is constexpr, so drawing a direction costs one table lookup.
+//
+// Every direction reserves a portion of the table that matches its weight.
+// For instance, the weight 25 out of a total of 100 corresponds to a 25%
+// chance and it receives 25% of the table's entries. The weights are
+// rounded to multiples of 1/256, the resolution of the table.
+class MovementTable {
+public:
+    static constexpr int SIZE_BITS = 8;
+    static constexpr int SIZE      = 1 << SIZE_BITS;
+
+public:
+    // A table without weights always draws UP.
+    constexpr MovementTable(): table_() {
     }
-    return Direction(random_direction);
-}
 
-inline Direction gen_random_weighted_vertical_direction(int up_weight, int up_left_weight, int up_right_weight) {
-    std::unordered_map<Direction, int> weight_of;
-    weight_of[Direction::UP]       = up_weight;
-    weight_of[Direction::UP_LEFT]  = up_left_weight;
-    weight_of[Direction::UP_RIGHT] = up_right_weight;
+    constexpr MovementTable(std::initializer_list<DirectionWeight> weights)
+        : MovementTable(weights.begin(), weights.end()) {
+    }
+
+    // Builds the table from the weights in [first, last), whose total
+    // must be above 0 and at most INT_MAX / SIZE.
+    constexpr MovementTable(const DirectionWeight* first, const DirectionWeight* last): table_() {
+        int total_weight = 0;
+        for(const DirectionWeight* weight = first; weight != last; ++weight)
+            total_weight += weight->weight;
+
+        int running_total = 0, entry = 0;
+        for(const DirectionWeight* weight = first; weight != last; ++weight) {
+            running_total += weight->weight;
 
-    int total_weight = up_weight + up_left_weight + up_right_weight;
-    int random_num = gen_random_num(1, total_weight);
-    int running_total = 0;
-    
-    // Reserve a portion of the range so that the odds of occurring match
-    // the weight of the direction that is specified. For instance, the 
-    // weight value 25 corresponds to a 25% chance and it recieves that 
-    // chance due to reserving 25 units of the total range defined above.
-    // The position of the 25 units is irrelvant, it doesn't matter if its
-    // the first 25, second 25, or last 25 units in the range.
-    for(auto &it: weight_of) {
-        running_total += it.second;
+            // The entries whose center falls within the running total.
+            const int last_entry = (running_total * SIZE + total_weight / 2) / total_weight;
+            for(; entry < last_entry && entry < SIZE; ++entry)
+                table_[entry] = weight->direction;
+        }
 
-        if(running_total >= random_num)
-            return it.first;
+        directions_ = 0;
+        for(const Direction direction: table_)
+            directions_ |= std::uint8_t(1 << int(direction));
     }
-    return Direction::INVALID;
-}
+
+    // Draws a direction from the distribution.
+    Direction sample() const {
+        return table_[thread_random().draw_bits(SIZE_BITS)];
+    }
+
+    // Returns true when the direction has a portion of the table.
+    constexpr bool can_draw(const Direction direction) const {
+        return (directions_ >> int(direction)) & 1;
+    }
+
+private:
+    std::array<Direction, SIZE> table_;
+
+    // One bit per direction that can be drawn, indexed by the direction.
+    std::uint8_t directions_ = 1 << int(Direction::UP);
+};
@@ -0,0 +1,161 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "material.hpp"
+#include "particle_types.hpp"
+#include "recording.hpp"
+
+// The first line of every recording, followed by the version.
+static const char* RECORDING_HEADER = "crumble-recording";
+static const int RECORDING_VERSION  = 2;
+
+bool save_recording(const Recording& recording, const std::string& path) {
+    std::ofstream file(path);
+    file << RECORDING_HEADER << ' ' << RECORDING_VERSION << '\n'
+         << "size "   << recording.width << ' ' << recording.height << '\n'
+         << "seed "   << recording.seed << '\n'
+         << "materials " << recording.material_fingerprint << '\n'
+         << "random " << recording.random.counter << ' ' << recording.random.bits << ' '
+                      << recording.random.bit_count << '\n';
+
+    for(const RecordedCommand& recorded: recording.commands) {
+        const BrushCommand& command = recorded.command;
+        if(command.kind == BrushKind::CLEAR) {
+            file << "clear " << recorded.tick << '\n';
+            continue;
+        }
+        file << "paint " << recorded.tick << ' ' << int(command.shape) << ' ' << int(command.material)
+             << ' ' << command.size << ' ' << command.x0 << ' ' << command.y0
+             << ' ' << command.x1 << ' ' << command.y1 << '\n';
+    }
+    file << "end " << recording.end_tick << '\n';
+
+    if(!file) {
+        std::cerr << "Couldn't write the recording: " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool load_recording(const std::string& path, Recording& recording) {
+    std::ifstream file(path);
+    if(!file) {
+        std::cerr << "Couldn't open the recording: " << path << '\n';
+        return false;
+    }
+
+    std::string header;
+    int version = 0;
+    if(!(file >> header >> version) || header != RECORDING_HEADER) {
+        std::cerr << "Not a recording: " << path << '\n';
+        return false;
+    }
+    if(version != RECORDING_VERSION) {
+        std::cerr << "The recording is version " << version << ", this build reads version "
+                  << RECORDING_VERSION << ": " << path << '\n';
+        return false;
+    }
+
+    Recording loaded;
+    bool has_ended = false;
+    std::string line;
+    int line_number = 1;
+
+    std::getline(file, line);
+    while(std::getline(file, line)) {
+        ++line_number;
+        std::istringstream stream(line);
+        std::string kind;
+        if(!(stream >> kind))
+            continue;
+
+        bool is_valid = true;
+        if(kind == "size") {
+            is_valid = bool(stream >> loaded.width >> loaded.height) && loaded.width > 0 && loaded.height > 0;
+        }
+        else if(kind == "seed") {
+            is_valid = bool(stream >> loaded.seed);
+        }
+        else if(kind == "materials") {
+            is_valid = bool(stream >> loaded.material_fingerprint);
+        }
+        else if(kind == "random") {
+            is_valid = bool(stream >> loaded.random.counter >> loaded.random.bits >> loaded.random.bit_count) &&
+                       loaded.random.bit_count >= 0 && loaded.random.bit_count <= 64;
+        }
+        else if(kind == "clear" || kind == "paint") {
+            RecordedCommand recorded;
+            BrushCommand& command = recorded.command;
+            int shape = 0, material = 0;
+
+            is_valid = bool(stream >> recorded.tick);
+            if(kind == "clear") {
+                command.kind = BrushKind::CLEAR;
+            }
+            else {
+                is_valid = is_valid && bool(stream >> shape >> material >> command.size >>
+                                            command.x0 >> command.y0 >> command.x1 >> command.y1);
+                command.shape    = BrushShape(shape);
+                command.material = MaterialId(material);
+                is_valid = is_valid && shape >= 0 && shape <= int(BrushShape::CIRCLE) &&
+                           material > ParticleType::EMPTY && material < material_registry().get_count() &&
+                           command.size > 0 && command.size <= MAX_BRUSH_SIZE &&
+                           std::abs(command.x0) <= MAX_BRUSH_COORDINATE && std::abs(command.y0) <= MAX_BRUSH_COORDINATE &&
+                           std::abs(command.x1) <= MAX_BRUSH_COORDINATE && std::abs(command.y1) <= MAX_BRUSH_COORDINATE;
+            }
+
+            // The commands are applied in order, so the ticks can't go back.
+            is_valid = is_valid && (loaded.commands.empty() || loaded.commands.back().tick <= recorded.tick);
+            loaded.commands.push_back(recorded);
+        }
+        else if(kind == "end") {
+            is_valid = bool(stream >> loaded.end_tick) &&
+                       (loaded.commands.empty() || loaded.commands.back().tick <= loaded.end_tick);
+            has_ended = true;
+        }
+        else {
+            is_valid = false;
+        }
+
+        if(!is_valid) {
+            std::cerr << "Invalid line " << line_number << " in the recording: " << path << '\n';
+            return false;
+        }
+    }
+
+    // A recording cut short misses the ticks after its last command.
+    if(!has_ended) {
+        std::cerr << "The recording has no end: " << path << '\n';
+        return false;
+    }
+
+    if(loaded.material_fingerprint != material_registry().get_fingerprint()) {
+        std::cerr << "The recording was made with other materials: " << path << '\n';
+        return false;
+    }
+
+    recording = std::move(loaded);
+    return true;
+}
+
+RecordingPlayer::RecordingPlayer(const Recording& recording): recording_(recording) {
+}
+
+void RecordingPlayer::start() {
+    thread_random().set_state(recording_.random);
+    next_command_ = 0;
+}
+
+void RecordingPlayer::apply_commands(World& world) {
+    const std::vector<RecordedCommand>& commands = recording_.commands;
+    while(next_command_ < commands.size() && commands[next_command_].tick <= world.get_tick()) {
+        apply_brush_command(commands[next_command_].command, world.get_grid());
+        ++next_command_;
+    }
+}
+
+bool RecordingPlayer::is_finished(const World& world) const {
+    return world.get_tick() >= recording_.end_tick;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "brush.hpp"
+#include "random.hpp"
+#include "world.hpp"
+
+// A brush command and the tick it was applied before.
+struct RecordedCommand {
+    std::uint64_t tick = 0;
+    BrushCommand command;
+};
+
+// A session that can be replayed tick for tick. It starts from an empty
+// world, and the brush commands are applied in order before the ticks
+// they were recorded at. Since the simulation only depends on its seed
+// and the materials, replaying the commands simulates the same ticks,
+// whatever the update mode or the number of threads.
+struct Recording {
+public:
+    int width  = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    std::uint64_t seed = 0;
+
+    // See MaterialRegistry::get_fingerprint. A recording only
+    // replays with the materials it was recorded with.
+    std::uint64_t material_fingerprint = 0;
+
+    // The generator of the thread applying the commands when the session
+    // started, which picks the colors of the particles painted.
+    Random::State random;
+
+    std::vector<RecordedCommand> commands;
+
+    // The tick the session ended at.
+    std::uint64_t end_tick = 0;
+};
+
+// The recordings are text files with one line per command, so they can be
+// attached to a report and read by someone. Return false when the file
+// can't be written or isn't a recording.
+bool save_recording(const Recording& recording, const std::string& path);
+bool load_recording(const std::string& path, Recording& recording);
+
+// Applies the commands of a recording to a world as its ticks come.
+class RecordingPlayer {
+public:
+    // The recording must outlive the player.
+    explicit RecordingPlayer(const Recording& recording);
+
+    // Restores the generator of the calling thread, which then has to
+    // apply the commands, and returns to the first command.
+    void start();
+
+    // Applies the commands recorded before the current tick of the world.
+    void apply_commands(World& world);
+
+    // Returns true once the world reached the end of the recording.
+    bool is_finished(const World& world) const;
+
+private:
+    const Recording& recording_;
+    std::size_t next_command_ = 0;
+};
@@ -0,0 +1,15 @@
+#version 330 core
+
+in vec2 texCoord;
+
+out vec4 FragColor;
+
+uniform usampler2D cells;  // The palette index of every cell.
+uniform sampler2D palette; // A row of 256 colors.
+
+void main() {
+    ivec2 size = textureSize(cells, 0);
+    ivec2 cell = min(ivec2(texCoord * vec2(size)), size - 1);
+    uint index = texelFetch(cells, cell, 0).r;
+    FragColor = vec4(texelFetch(palette, ivec2(int(index), 0), 0).rgb, 1.0f);
+}
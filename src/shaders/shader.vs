@@ -1,18 +1,20 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aTranslation;
-layout (location = 2) in vec3 aColor;
+layout (location = 1) in uint aInstance; // x: 12 bits, y: 12 bits, palette index: 8 bits
 
 out vec3 particleColor;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+uniform vec2 gridSize;
+uniform sampler2D palette; // A row of 256 colors.
 
 void main() {
-    gl_Position = vec4(aTranslation + aPos, 1.0f);
-    particleColor = aColor;
-    //gl_Position = model * vec4(aPos, 1.0f);
-    //gl_Position = proj * view * model * vec4(aPos, 1.0f);
+    uint x     = aInstance & 0xFFFu;
+    uint y     = (aInstance >> 12) & 0xFFFu;
+    uint index = aInstance >> 24;
+
+    // Convert from the grid to ndc.
+    vec2 translation = vec2(x, y) / gridSize * 2.0f - 1.0f;
+    gl_Position = vec4(vec3(translation, 0.0f) + aPos, 1.0f);
+    particleColor = texelFetch(palette, ivec2(int(index), 0), 0).rgb;
 }
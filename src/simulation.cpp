@@ -0,0 +1,122 @@
+#include <iostream>
+
+#include "simulation.hpp"
+#include "gravity.hpp"
+#include "particle.hpp"
+#include "random.hpp"
+
+Simulation::Simulation(Grid& grid, const std::uint64_t seed, const int thread_count)
+    : grid_(grid), seed_(seed), thread_count_(thread_count) {
+}
+
+void Simulation::step() {
+    grid_.begin_tick(tick_);
+    grid_.wake_due_cells();
+    grid_.update_chunk_rects();
+    awake_chunk_count_ = 0;
+    updated_cell_count_.store(0);
+
+    for(std::vector<int>& phase: phases_)
+        phase.clear();
+
+    std::vector<Chunk>& chunks = grid_.chunks();
+    for(int i = 0; i < int(chunks.size()); ++i) {
+        if(chunks[i].is_awake()) {
+            phases_[chunks[i].get_phase()].push_back(i);
+            ++awake_chunk_count_;
+        }
+    }
+
+    // The calling thread also updates chunks, which reseeds its generator.
+    // It is restored so the particles the caller places between ticks
+    // don't depend on which chunks it happened to update.
+    const Random::State caller_random = thread_random().get_state();
+
+    switch(update_mode_) {
+        case UpdateMode::SERIAL:   step_serial();   break;
+        case UpdateMode::PARALLEL: step_parallel(); break;
+        case UpdateMode::VERIFY:   step_verified(); break;
+    }
+    updated_cell_count_ += leveler_.level_liquids(grid_);
+    thread_random().set_state(caller_random);
+    ++tick_;
+}
+
+void Simulation::set_update_mode(const UpdateMode mode) {
+    if(mode != UpdateMode::SERIAL && !thread_pool_)
+        thread_pool_ = std::make_unique<ThreadPool>(thread_count_);
+    update_mode_ = mode;
+}
+
+UpdateMode Simulation::get_update_mode() const {
+    return update_mode_;
+}
+
+int Simulation::get_awake_chunk_count() const {
+    return awake_chunk_count_;
+}
+
+std::uint64_t Simulation::get_updated_cell_count() const {
+    return updated_cell_count_.load();
+}
+
+std::uint64_t Simulation::get_tick() const {
+    return tick_;
+}
+
+void Simulation::step_serial() {
+    for(const std::vector<int>& phase: phases_) {
+        for(const int index: phase)
+            updated_cell_count_ += update_chunk(index);
+    }
+}
+
+void Simulation::step_parallel() {
+    // Each phase has to finish before the next one starts, since
+    // the chunks of the next phase neighbor the ones just updated.
+    for(const std::vector<int>& phase: phases_) {
+        thread_pool_->parallel_for(phase.size(), [&](int i) {
+            updated_cell_count_ += update_chunk(phase[i]);
+        });
+    }
+}
+
+void Simulation::step_verified() {
+    const GridState before = grid_.save_state();
+    step_parallel();
+    const GridState parallel = grid_.save_state();
+
+    grid_.load_state(before);
+    updated_cell_count_.store(0);
+    step_serial();
+
+    if(grid_.save_state() != parallel) {
+        std::cerr << "Warn: the serial and parallel updates differ on tick "
+                  << tick_ << '\n';
+    }
+}
+
+int Simulation::update_chunk(const int index) {
+    const DirtyRect& rect = grid_.chunks()[index].rect;
+    seed_random(hash_seed(seed_, tick_, index));
+    int updated_cell_count = 0;
+
+    // Update from the bottom row up, so a column of falling
+    // particles moves together instead of one row per frame.
+    for(int j = rect.min_y; j <= rect.max_y; ++j) {
+        // The particles that fall straight down are moved first,
+        // the rules only update the ones that didn't move yet.
+        updated_cell_count += apply_gravity_to_row(grid_, j, rect.min_x, rect.max_x);
+
+        // The empty cells are skipped with the occupancy bitmap. A particle
+        // can move ahead in the row, which is found again and skipped.
+        for(int i = grid_.next_occupied_x(rect.min_x, j, rect.max_x); i <= rect.max_x;
+                i = grid_.next_occupied_x(i + 1, j, rect.max_x)) {
+            if(grid_.mark_updated(i, j)) {
+                update_particle(i, j, grid_);
+                ++updated_cell_count;
+            }
+        }
+    }
+    return updated_cell_count;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "grid.hpp"
+#include "leveling.hpp"
+#include "thread_pool.hpp"
+
+// How the chunks of a tick are distributed across threads.
+enum class UpdateMode: int {
+    SERIAL   = 0, // Every chunk is updated on the calling thread.
+    PARALLEL = 1, // The chunks of each checkerboard phase are split across a thread pool.
+    VERIFY   = 2  // Runs both modes from the same state and reports when they differ.
+};
+
+// Advances the particles stored in a grid. Only the cells inside the dirty
+// rects of awake chunks are updated, so the cost of a tick scales with the
+// activity in the world rather than with its area.
+//
+// The chunks are updated in a four-phase checkerboard. No two chunks of the
+// same phase are neighbors, and a particle never reaches further than half
+// a chunk, so the chunks of a phase can be updated at the same time. Every
+// chunk seeds the random numbers it draws from the seed of the simulation,
+// the tick and its position, which makes the result independent of which
+// thread updated it and the serial and parallel modes equivalent. The
+// bodies of liquid reach further, they are leveled on the calling thread
+// once every chunk is updated, see LiquidLeveler.
+class Simulation {
+public:
+    // A thread_count of 0 uses one thread per hardware thread.
+    Simulation(Grid& grid, const std::uint64_t seed = 0, const int thread_count = 0);
+    Simulation(const Simulation& other)            = delete;
+    Simulation& operator=(const Simulation& other) = delete;
+
+    // Advances every awake chunk by one tick.
+    void step();
+
+    // The thread pool is created the first time a parallel mode is used.
+    void set_update_mode(const UpdateMode mode);
+    UpdateMode get_update_mode() const;
+
+    // Returns the number of chunks updated during the previous tick.
+    int get_awake_chunk_count() const;
+
+    // Returns the number of particles updated during the previous tick.
+    std::uint64_t get_updated_cell_count() const;
+
+    // Returns the number of ticks that have been simulated.
+    std::uint64_t get_tick() const;
+
+    // The seed is replaced when a snapshot is loaded.
+    std::uint64_t get_seed() const          { return seed_; }
+    void set_seed(const std::uint64_t seed) { seed_ = seed; }
+
+    // Continues from the tick, which is used when the grid holds a copy of
+    // part of a larger world, see SparseWorld, or a snapshot is loaded.
+    void set_tick(const std::uint64_t tick) { tick_ = tick; }
+
+private:
+    void step_serial();
+    void step_parallel();
+    void step_verified();
+
+    // Returns the number of particles updated.
+    int update_chunk(const int index);
+
+private:
+    Grid& grid_;
+    std::uint64_t seed_;
+    int thread_count_;
+    std::uint64_t tick_    = 0;
+    UpdateMode update_mode_ = UpdateMode::SERIAL;
+    std::unique_ptr<ThreadPool> thread_pool_;
+
+    // The indices of the awake chunks of each checkerboard phase.
+    std::vector<int> phases_[4];
+    int awake_chunk_count_ = 0;
+    std::atomic<std::uint64_t> updated_cell_count_{0};
+
+    LiquidLeveler leveler_;
+};
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <chrono>
+
+#include "material.hpp"
+#include "particle.hpp"
+#include "particle_types.hpp"
+#include "simulation_thread.hpp"
+
+SimulationThread::SimulationThread(World& world, const int tick_rate,
+                                   Recording* recording, const Recording* replay)
+    : world_(world),
+      recording_(recording),
+      tick_rate_(std::max(tick_rate, UNLIMITED_TICK_RATE)),
+      update_mode_(int(world.get_simulation().get_update_mode())) {
+    const std::vector<Chunk>& chunks = world_.get_grid().chunks();
+
+    for(Snapshot& snapshot: snapshots_) {
+        snapshot.width  = world_.get_width();
+        snapshot.height = world_.get_height();
+        snapshot.palette_indices.assign(std::size_t(snapshot.width) * snapshot.height, 0);
+        snapshot.changed_rects.assign(chunks.size(), DirtyRect());
+        snapshot.material_counts.assign(material_registry().get_count(), 0);
+    }
+
+    // Nothing has been written to the snapshots yet.
+    for(std::vector<DirtyRect>& stale_rects: stale_rects_) {
+        for(const Chunk& chunk: chunks) {
+            DirtyRect all;
+            all.expand(chunk.x, chunk.y,
+                       std::min(chunk.x + CHUNK_SIZE, world_.get_width()) - 1,
+                       std::min(chunk.y + CHUNK_SIZE, world_.get_height()) - 1);
+            stale_rects.push_back(all);
+        }
+    }
+    pending_rects_.assign(chunks.size(), DirtyRect());
+
+    if(recording_) {
+        recording_->width    = world_.get_width();
+        recording_->height   = world_.get_height();
+        recording_->seed     = world_.get_simulation().get_seed();
+        recording_->material_fingerprint = material_registry().get_fingerprint();
+        recording_->commands.clear();
+    }
+    if(replay)
+        player_ = std::make_unique<RecordingPlayer>(*replay);
+
+    // There's always a snapshot of the world to read.
+    publish();
+    thread_ = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::stop() {
+    if(!thread_.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        is_running_ = false;
+    }
+    wake_condition_.notify_one();
+    thread_.join();
+
+    if(recording_)
+        recording_->end_tick = world_.get_tick();
+}
+
+void SimulationThread::set_tick_rate(const int tick_rate) {
+    if(std::max(tick_rate, UNLIMITED_TICK_RATE) == tick_rate_)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        tick_rate_ = std::max(tick_rate, UNLIMITED_TICK_RATE);
+    }
+    wake_condition_.notify_one();
+}
+
+int SimulationThread::get_tick_rate() const {
+    return tick_rate_;
+}
+
+void SimulationThread::set_update_mode(const UpdateMode mode) {
+    update_mode_ = int(mode);
+}
+
+bool SimulationThread::push_brush_command(const BrushCommand& command) {
+    return brush_commands_.push(command);
+}
+
+void SimulationThread::run() {
+    using Clock = std::chrono::steady_clock;
+
+    // The colors of the particles painted are drawn on this thread.
+    if(recording_)
+        recording_->random = thread_random().get_state();
+    if(player_)
+        player_->start();
+
+    Clock::time_point next_tick = Clock::now();
+
+    while(is_running_) {
+        const int tick_rate     = tick_rate_;
+        const bool is_unlimited = tick_rate == UNLIMITED_TICK_RATE;
+        const auto period       = is_unlimited ? Clock::duration::zero() :
+            std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / tick_rate));
+
+        // Run the ticks that are due, which is more than one when the
+        // simulation runs faster than it is drawn or fell behind.
+        int ticks = 0;
+        while(ticks < MAX_CATCH_UP_TICKS && (is_unlimited || Clock::now() >= next_tick) &&
+              !is_replay_finished()) {
+            tick();
+            next_tick += period;
+            ++ticks;
+        }
+
+        // Don't try to catch up with ticks it can't keep up with.
+        if(Clock::now() >= next_tick)
+            next_tick = Clock::now();
+
+        if(ticks > 0)
+            publish();
+
+        // A finished replay only waits to be stopped.
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        const auto is_woken = [&] {
+            return !is_running_ || tick_rate_ != tick_rate;
+        };
+        if(is_replay_finished())
+            wake_condition_.wait(lock, is_woken);
+        else
+            wake_condition_.wait_until(lock, next_tick, is_woken);
+
+        // A new rate starts counting from now.
+        if(tick_rate_ != tick_rate)
+            next_tick = Clock::now();
+    }
+}
+
+void SimulationThread::tick() {
+    // The commands pushed during a replay are dropped, they
+    // would change what happens from the recorded session.
+    BrushCommand command;
+    while(brush_commands_.pop(command)) {
+        if(player_)
+            continue;
+        if(recording_)
+            recording_->commands.push_back({world_.get_tick(), command});
+        apply_brush_command(command, world_.get_grid());
+    }
+    if(player_)
+        player_->apply_commands(world_);
+
+    Simulation& simulation = world_.get_simulation();
+    if(UpdateMode(update_mode_.load()) != simulation.get_update_mode())
+        simulation.set_update_mode(UpdateMode(update_mode_.load()));
+
+    world_.step();
+
+    const std::vector<Chunk>& chunks = world_.get_grid().chunks();
+    for(std::size_t i = 0; i < chunks.size(); ++i) {
+        const DirtyRect changed = chunks[i].get_changed_rect();
+        if(changed.is_empty())
+            continue;
+
+        pending_rects_[i].expand(changed);
+        stale_rects_[0][i].expand(changed);
+        stale_rects_[1][i].expand(changed);
+    }
+    ++pending_ticks_;
+}
+
+bool SimulationThread::is_replay_finished() const {
+    return player_ && player_->is_finished(world_);
+}
+
+void SimulationThread::publish() {
+    // Only this thread changes which buffer is the front buffer.
+    const int back = 1 - front_;
+    Snapshot& snapshot = snapshots_[back];
+    const Grid& grid = world_.get_grid();
+
+    for(DirtyRect& rect: stale_rects_[back]) {
+        for(int y = rect.min_y; y <= rect.max_y; ++y) {
+            std::uint8_t* row = &snapshot.palette_indices[std::size_t(y) * snapshot.width];
+            for(int x = rect.min_x; x <= rect.max_x; ++x)
+                row[x] = get_palette_index(grid, Cell(x, y));
+        }
+        rect = DirtyRect();
+    }
+
+    snapshot.tick               = world_.get_tick();
+    snapshot.particle_count     = world_.count();
+
+    snapshot.occupied_chunk_count = 0;
+    for(std::size_t i = 0; i < grid.chunks().size(); ++i)
+        snapshot.occupied_chunk_count += !grid.is_chunk_empty(int(i));
+    for(std::size_t material = 0; material < snapshot.material_counts.size(); ++material)
+        snapshot.material_counts[material] = world_.count_of(MaterialId(material));
+
+    snapshot.awake_chunk_count  = world_.get_simulation().get_awake_chunk_count();
+    snapshot.updated_cell_count = world_.get_simulation().get_updated_cell_count();
+
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        const Snapshot& front = snapshots_[front_];
+
+        // The changes of a snapshot nobody read are carried over.
+        snapshot.changed_rects = pending_rects_;
+        snapshot.ticks         = pending_ticks_;
+        if(!front_was_read_) {
+            for(std::size_t i = 0; i < pending_rects_.size(); ++i)
+                snapshot.changed_rects[i].expand(front.changed_rects[i]);
+            snapshot.ticks += front.ticks;
+        }
+        snapshot.sequence = front.sequence + 1;
+
+        front_          = back;
+        front_was_read_ = false;
+    }
+
+    for(DirtyRect& rect: pending_rects_)
+        rect = DirtyRect();
+    pending_ticks_ = 0;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "brush.hpp"
+#include "chunk.hpp"
+#include "recording.hpp"
+#include "simulation.hpp"
+#include "spsc_queue.hpp"
+#include "world.hpp"
+
+// A read-only copy of the world made after a tick, which is what gets drawn.
+struct Snapshot {
+public:
+    int width = 0, height = 0;
+
+    // The palette index of every cell, stored like the cells of the grid.
+    std::vector<std::uint8_t> palette_indices;
+
+    // One rect per chunk, the cells that changed since the previous
+    // snapshot that was read. Skipped snapshots are included.
+    std::vector<DirtyRect> changed_rects;
+
+    std::uint64_t sequence = 0; // Increases with every snapshot, starting at 1.
+    std::uint64_t tick     = 0;
+    int ticks              = 0; // The ticks since the previous snapshot that was read.
+
+    int particle_count     = 0;
+    int awake_chunk_count  = 0;
+    int occupied_chunk_count = 0;
+
+    // The number of particles of every material, indexed by MaterialId.
+    std::vector<int> material_counts;
+
+    std::uint64_t updated_cell_count = 0; // During the last tick.
+};
+
+// Steps a world on its own thread at a fixed rate, independent of how fast
+// it is drawn. After the ticks that are due, the state of the world is
+// published as a Snapshot.
+//
+// The snapshots are double-buffered. The simulation writes the back buffer
+// while the front buffer can be read, and only the cells that changed since
+// a buffer was last written are copied into it. The world must not be
+// accessed by other threads while this is running, changes are requested
+// and applied between two ticks.
+//
+// The brush commands can be recorded, or a recording can be replayed
+// instead of applying the commands pushed. A replay stops ticking once it
+// reaches the end of the recording.
+class SimulationThread {
+public:
+    // Ticks simulated before publishing a snapshot when the simulation falls
+    // behind. The ticks that are still due after that are dropped.
+    static constexpr int MAX_CATCH_UP_TICKS = 8;
+
+    // The brush commands that can wait for the next tick.
+    static constexpr std::size_t BRUSH_QUEUE_CAPACITY = 1024;
+
+    // Runs the ticks as fast as possible instead of at a fixed rate.
+    static constexpr int UNLIMITED_TICK_RATE = 0;
+
+public:
+    // The commands applied are appended to the recording when it isn't
+    // null, and the commands of the replay are applied instead of the
+    // ones pushed when it isn't null. Both must outlive the thread, and
+    // the recording can't be read until the thread stopped. The recording
+    // must start from the world as it is, empty and at tick 0.
+    SimulationThread(World& world, const int tick_rate = 60,
+                     Recording* recording = nullptr, const Recording* replay = nullptr);
+    ~SimulationThread();
+    SimulationThread(const SimulationThread& other)            = delete;
+    SimulationThread& operator=(const SimulationThread& other) = delete;
+
+    // Calls the function with the latest snapshot. A new snapshot can't be
+    // published until it returns, so the function should only copy or upload.
+    template<typename Function>
+    void read_snapshot(Function&& function) {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        function(static_cast<const Snapshot&>(snapshots_[front_]));
+        front_was_read_ = true;
+    }
+
+    // Stops ticking, which also sets the end of the recording.
+    // The destructor calls this.
+    void stop();
+
+    // The number of ticks per second, or UNLIMITED_TICK_RATE.
+    void set_tick_rate(const int tick_rate);
+    int get_tick_rate() const;
+
+    // These are applied before the next tick. The brush commands are
+    // applied in order and must all be pushed by the same thread. Returns
+    // false when the command was dropped since the queue is full.
+    void set_update_mode(const UpdateMode mode);
+    bool push_brush_command(const BrushCommand& command);
+
+private:
+    void run();
+
+    // Applies the changes requested since the previous tick and steps the world.
+    void tick();
+
+    // Copies the state of the world into the back buffer and swaps the buffers.
+    void publish();
+
+    bool is_replay_finished() const;
+
+private:
+    World& world_;
+    std::thread thread_;
+
+    Recording* recording_;
+    std::unique_ptr<RecordingPlayer> player_;
+
+    std::atomic<bool> is_running_{true};
+    std::atomic<int>  tick_rate_;
+    std::atomic<int>  update_mode_;
+    SpscQueue<BrushCommand, BRUSH_QUEUE_CAPACITY> brush_commands_;
+
+    // Wakes the thread early when it is being stopped or the tick rate changed.
+    std::mutex wake_mutex_;
+    std::condition_variable wake_condition_;
+
+    std::mutex snapshot_mutex_;
+    Snapshot snapshots_[2];
+    int front_ = 0;
+    bool front_was_read_ = false;
+
+    // The cells that changed since each snapshot was written, one rect
+    // per chunk. Only the simulation thread accesses these.
+    std::vector<DirtyRect> stale_rects_[2];
+
+    // The cells and ticks since the previous snapshot was published.
+    std::vector<DirtyRect> pending_rects_;
+    int pending_ticks_ = 0;
+};
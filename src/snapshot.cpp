@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "material.hpp"
+#include "particle_types.hpp"
+#include "random.hpp"
+#include "snapshot.hpp"
+
+static const char SNAPSHOT_MAGIC[8] = {'C', 'R', 'U', 'M', 'B', 'L', 'E', 'S'};
+
+// A run of equal values is stored as a control byte of 128 + length - 2
+// followed by the value, and values that don't repeat as a control byte
+// of length - 1 followed by the values.
+static const int MAX_RUN_LENGTH     = 129;
+static const int MAX_LITERAL_LENGTH = 128;
+
+// A read-only view of a whole file mapped into memory.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if(file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+            return;
+
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!mapping_)
+            return;
+        data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        size_ = data_ ? std::size_t(size.QuadPart) : 0;
+#else
+        const int file = open(path.c_str(), O_RDONLY);
+        if(file < 0)
+            return;
+
+        struct stat status;
+        if(fstat(file, &status) == 0 && status.st_size > 0) {
+            void* data = mmap(nullptr, std::size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if(data != MAP_FAILED) {
+                data_ = static_cast<const char*>(data);
+                size_ = std::size_t(status.st_size);
+            }
+        }
+        close(file);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if(data_)
+            UnmapViewOfFile(data_);
+        if(mapping_)
+            CloseHandle(mapping_);
+        if(file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+#else
+        if(data_)
+            munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    MappedFile(const MappedFile& other)            = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    bool is_open() const     { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+#ifdef _WIN32
+    HANDLE file_    = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Reads values from a buffer, failing instead of reading past its end.
+class Reader {
+public:
+    Reader(const char* data, const std::size_t size): position_(data), end_(data + size) {}
+
+    template<typename T>
+    bool read(T& value) {
+        if(std::size_t(end_ - position_) < sizeof(T))
+            return false;
+        std::memcpy(&value, position_, sizeof(T));
+        position_ += sizeof(T);
+        return true;
+    }
+
+    // Decodes count run-length encoded values. The values are
+    // skipped instead when they are null.
+    template<typename T>
+    bool read_runs(T* values, const int count) {
+        int i = 0;
+        while(i < count) {
+            std::uint8_t control;
+            if(!read(control))
+                return false;
+
+            const bool is_run = control >= MAX_LITERAL_LENGTH;
+            const int length  = is_run ? control - MAX_LITERAL_LENGTH + 2 : control + 1;
+            const std::size_t size = (is_run ? 1 : length) * sizeof(T);
+            if(length > count - i || std::size_t(end_ - position_) < size)
+                return false;
+
+            if(values && is_run) {
+                T value;
+                std::memcpy(&value, position_, sizeof(T));
+                std::fill_n(values + i, length, value);
+            }
+            else if(values) {
+                std::memcpy(values + i, position_, size);
+            }
+            position_ += size;
+            i += length;
+        }
+        return true;
+    }
+
+private:
+    const char* position_;
+    const char* end_;
+};
+
+// Appends values to a buffer.
+class Writer {
+public:
+    template<typename T>
+    void write(const T& value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        buffer_.insert(buffer_.end(), bytes, bytes + sizeof(T));
+    }
+
+    // Encodes the values as runs of equal values and runs of literals.
+    template<typename T>
+    void write_runs(const T* values, const int count) {
+        int i = 0;
+        while(i < count) {
+            int run = 1;
+            while(i + run < count && run < MAX_RUN_LENGTH && values[i + run] == values[i])
+                ++run;
+
+            if(run >= 2) {
+                write(std::uint8_t(MAX_LITERAL_LENGTH + run - 2));
+                write(values[i]);
+                i += run;
+                continue;
+            }
+
+            // The literals stop where the next run starts.
+            int length = 1;
+            while(i + length < count && length < MAX_LITERAL_LENGTH &&
+                  !(i + length + 1 < count && values[i + length] == values[i + length + 1]))
+                ++length;
+
+            write(std::uint8_t(length - 1));
+            for(int j = 0; j < length; ++j)
+                write(values[i + j]);
+            i += length;
+        }
+    }
+
+    const std::vector<char>& get_buffer() const { return buffer_; }
+
+private:
+    std::vector<char> buffer_;
+};
+
+static void write_header(Writer& writer, const SnapshotInfo& info, const Random::State& random) {
+    writer.write(SNAPSHOT_MAGIC);
+    writer.write(info.version);
+    writer.write(std::int32_t(info.width));
+    writer.write(std::int32_t(info.height));
+    writer.write(info.seed);
+    writer.write(info.tick);
+    writer.write(info.material_fingerprint);
+    writer.write(random.counter);
+    writer.write(random.bits);
+    writer.write(std::int32_t(random.bit_count));
+}
+
+static bool read_header(Reader& reader, SnapshotInfo& info, Random::State& random) {
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    std::int32_t width, height, bit_count;
+
+    if(!reader.read(magic) || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 ||
+       !reader.read(info.version))
+        return false;
+
+    // The rest of the header might change between versions.
+    if(info.version != SNAPSHOT_VERSION)
+        return true;
+
+    if(!reader.read(width) || !reader.read(height) || !reader.read(info.seed) || !reader.read(info.tick) ||
+       !reader.read(info.material_fingerprint) || !reader.read(random.counter) || !reader.read(random.bits) || !reader.read(bit_count))
+        return false;
+
+    info.width       = width;
+    info.height      = height;
+    random.bit_count = bit_count;
+    return width > 0 && height > 0 && bit_count >= 0 && bit_count <= 64;
+}
+
+static void write_chunk(Writer& writer, const Chunk& chunk, const ChunkCells& cells) {
+    // The rect of the current tick is replaced when the next tick starts.
+    const DirtyRect next_rect = chunk.next_rect.load();
+    writer.write(std::int32_t(next_rect.min_x));
+    writer.write(std::int32_t(next_rect.min_y));
+    writer.write(std::int32_t(next_rect.max_x));
+    writer.write(std::int32_t(next_rect.max_y));
+
+    writer.write(std::uint32_t(cells.timers.size()));
+    for(const CellTimer& timer: cells.timers) {
+        writer.write(timer.tick);
+        writer.write(std::uint8_t(timer.rect.min_x));
+        writer.write(std::uint8_t(timer.rect.min_y));
+        writer.write(std::uint8_t(timer.rect.max_x));
+        writer.write(std::uint8_t(timer.rect.max_y));
+    }
+
+    writer.write_runs(cells.materials.data(),       ChunkCells::SIZE);
+    writer.write_runs(cells.lifetimes.data(),       ChunkCells::SIZE);
+    writer.write_runs(cells.ignition_delays.data(), ChunkCells::SIZE);
+    writer.write_runs(cells.color_seeds.data(),     ChunkCells::SIZE);
+}
+
+// Returns false when the chunk is truncated or holds anything the grid
+// can't, like an unknown material or a rect outside of the chunk. Only
+// the materials are decoded when is_checking, the rest is skipped.
+static bool read_chunk(Reader& reader, const Chunk& chunk, const int width, const int height,
+                       const bool is_checking, DirtyRect& next_rect, ChunkCells& cells) {
+    std::int32_t min_x, min_y, max_x, max_y;
+    if(!reader.read(min_x) || !reader.read(min_y) || !reader.read(max_x) || !reader.read(max_y))
+        return false;
+
+    next_rect = DirtyRect();
+    if(min_x <= max_x && min_y <= max_y) {
+        if(min_x < chunk.x || min_y < chunk.y || max_x >= std::min(chunk.x + CHUNK_SIZE, width) ||
+           max_y >= std::min(chunk.y + CHUNK_SIZE, height))
+            return false;
+        next_rect.expand(min_x, min_y, max_x, max_y);
+    }
+
+    // The timers are few, they are decoded even when checking.
+    std::uint32_t timer_count;
+    if(!reader.read(timer_count))
+        return false;
+
+    cells.timers.clear();
+    for(std::uint32_t i = 0; i < timer_count; ++i) {
+        std::uint64_t tick;
+        std::uint8_t timer_min_x, timer_min_y, timer_max_x, timer_max_y;
+        if(!reader.read(tick) || !reader.read(timer_min_x) || !reader.read(timer_min_y) ||
+           !reader.read(timer_max_x) || !reader.read(timer_max_y) ||
+           timer_min_x > timer_max_x || timer_min_y > timer_max_y ||
+           timer_max_x >= std::min(CHUNK_SIZE, width - chunk.x) || timer_max_y >= std::min(CHUNK_SIZE, height - chunk.y))
+            return false;
+        cells.timers.push_back({tick, {timer_min_x, timer_min_y, timer_max_x, timer_max_y}});
+    }
+    if(!std::is_heap(cells.timers.begin(), cells.timers.end(), CellTimer::is_later))
+        return false;
+
+    if(!reader.read_runs(cells.materials.data(), ChunkCells::SIZE) ||
+       !reader.read_runs(is_checking ? nullptr : cells.lifetimes.data(),       ChunkCells::SIZE) ||
+       !reader.read_runs(is_checking ? nullptr : cells.ignition_delays.data(), ChunkCells::SIZE) ||
+       !reader.read_runs(is_checking ? nullptr : cells.color_seeds.data(),     ChunkCells::SIZE))
+        return false;
+
+    if(is_checking) {
+        const int material_count = material_registry().get_count();
+        for(const MaterialId material: cells.materials) {
+            if(material >= material_count)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool save_snapshot(const World& world, const std::string& path) {
+    const Grid& grid = world.get_grid();
+    const Simulation& simulation = world.get_simulation();
+
+    SnapshotInfo info;
+    info.version = SNAPSHOT_VERSION;
+    info.width   = grid.get_width();
+    info.height  = grid.get_height();
+    info.seed    = simulation.get_seed();
+    info.tick    = simulation.get_tick();
+    info.material_fingerprint = material_registry().get_fingerprint();
+
+    Writer writer;
+    write_header(writer, info, thread_random().get_state());
+
+    ChunkCells cells;
+    for(int i = 0; i < int(grid.chunks().size()); ++i) {
+        grid.copy_chunk_to(i, cells);
+        write_chunk(writer, grid.chunks()[i], cells);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(writer.get_buffer().data(), std::streamsize(writer.get_buffer().size()));
+    if(!file) {
+        std::cerr << "Couldn't write the snapshot: " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool read_snapshot_info(const std::string& path, SnapshotInfo& info) {
+    const MappedFile file(path);
+    Reader reader(file.data(), file.size());
+    Random::State random;
+
+    if(!file.is_open() || !read_header(reader, info, random)) {
+        std::cerr << "Not a snapshot: " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool load_snapshot(World& world, const std::string& path) {
+    const MappedFile file(path);
+    if(!file.is_open()) {
+        std::cerr << "Couldn't open the snapshot: " << path << '\n';
+        return false;
+    }
+
+    Grid& grid = world.get_grid();
+    SnapshotInfo info;
+    Random::State random;
+    Reader header_reader(file.data(), file.size());
+
+    if(!read_header(header_reader, info, random)) {
+        std::cerr << "Not a snapshot: " << path << '\n';
+        return false;
+    }
+    if(info.version != SNAPSHOT_VERSION) {
+        std::cerr << "The snapshot is version " << info.version
+                  << ", this build reads version " << SNAPSHOT_VERSION << ": " << path << '\n';
+        return false;
+    }
+    if(info.width != grid.get_width() || info.height != grid.get_height()) {
+        std::cerr << "The snapshot is " << info.width << 'x' << info.height << ", the world is "
+                  << grid.get_width() << 'x' << grid.get_height() << ": " << path << '\n';
+        return false;
+    }
+    if(info.material_fingerprint != material_registry().get_fingerprint()) {
+        std::cerr << "The snapshot was saved with other materials: " << path << '\n';
+        return false;
+    }
+
+    // Every chunk is checked before the world is changed, which
+    // only decodes the materials and costs much less than copying
+    // the cells into the grid.
+    ChunkCells cells;
+    DirtyRect next_rect;
+    {
+        Reader reader = header_reader;
+        for(const Chunk& chunk: grid.chunks()) {
+            if(!read_chunk(reader, chunk, info.width, info.height, true, next_rect, cells)) {
+                std::cerr << "The snapshot is corrupted: " << path << '\n';
+                return false;
+            }
+        }
+    }
+
+    // The loaded particles must not look updated during the next tick.
+    grid.begin_tick(info.tick);
+
+    // A whole row of chunks is decoded before it is copied into the grid,
+    // which then writes the rows of cells in order.
+    const int chunk_columns = (info.width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<ChunkCells> row_cells(chunk_columns);
+
+    Reader reader = header_reader;
+    for(int first = 0; first < int(grid.chunks().size()); first += chunk_columns) {
+        for(int i = 0; i < chunk_columns; ++i) {
+            Chunk& chunk = grid.chunks()[first + i];
+            read_chunk(reader, chunk, info.width, info.height, false, next_rect, row_cells[i]);
+            chunk.rect = DirtyRect();
+            chunk.next_rect.store(next_rect);
+        }
+        grid.copy_chunks_from(first, chunk_columns, row_cells.data());
+    }
+
+    world.get_simulation().set_seed(info.seed);
+    world.get_simulation().set_tick(info.tick);
+    thread_random().set_state(random);
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "world.hpp"
+
+// Snapshots store the whole state of a world in a compact binary file, so
+// a scene can be started from a prebuilt world instead of simulating its
+// setup again. A snapshot holds every cell with its lifetime, ignition
+// delay and color, the cells every chunk simulates during the next tick
+// and the ones it wakes later, the seed and tick of the simulation and the
+// random generator of the thread that saved it. A world loaded from a
+// snapshot continues exactly like the world that was saved, so a snapshot
+// is refused when the materials aren't the ones it was saved with.
+//
+// The file starts with a header followed by the chunks in the order of the
+// grid. Every array of a chunk is run-length encoded on its own, so the
+// empty and uniform regions take a few bytes per chunk. The numbers are
+// stored in the byte order of the machine, which is little-endian on every
+// platform crumble runs on.
+
+// The version of the format written by save_snapshot. Loading a snapshot
+// of another version fails.
+inline const std::uint32_t SNAPSHOT_VERSION = 4;
+
+// The size of the world and the state of the simulation in a snapshot.
+struct SnapshotInfo {
+    std::uint32_t version = 0;
+    int width             = 0;
+    int height            = 0;
+    std::uint64_t seed    = 0;
+    std::uint64_t tick    = 0;
+
+    // See MaterialRegistry::get_fingerprint.
+    std::uint64_t material_fingerprint = 0;
+};
+
+// Writes the state of the world to the file. Returns false when
+// the file can't be written.
+bool save_snapshot(const World& world, const std::string& path);
+
+// Reads the header of the snapshot, which tells the size of the world
+// to create before loading it. Returns false when the file isn't a
+// snapshot.
+bool read_snapshot_info(const std::string& path, SnapshotInfo& info);
+
+// Replaces the state of the world with the snapshot, which must be of the
+// same size. The file is mapped into memory and decoded straight into the
+// chunks. Returns false and leaves the world unchanged when the file
+// isn't a valid snapshot for it.
+bool load_snapshot(World& world, const std::string& path);
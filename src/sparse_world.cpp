@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <numeric>
+
+#include "particle.hpp"
+#include "particle_types.hpp"
+#include "random.hpp"
+#include "sparse_world.hpp"
+
+// Returns the coordinate of the chunk storing the cell, rounding down
+// so the cells at negative coordinates belong to negative chunks.
+static int chunk_coordinate_of(const int cell) {
+    return (cell >= 0 ? cell : cell - (CHUNK_SIZE - 1)) / CHUNK_SIZE;
+}
+
+// Returns the index of the cell within the cells of its chunk.
+static int cell_index_of(const int x, const int y) {
+    const int local_x = x - chunk_coordinate_of(x) * CHUNK_SIZE;
+    const int local_y = y - chunk_coordinate_of(y) * CHUNK_SIZE;
+    return local_y * CHUNK_SIZE + local_x;
+}
+
+// Returns the coordinate of the tile holding the chunk, see Island.
+static int tile_coordinate_of(const int chunk) {
+    return (chunk >= 0 ? chunk : chunk - (SparseWorld::ISLAND_TILE_SIZE - 1)) / SparseWorld::ISLAND_TILE_SIZE;
+}
+
+static DirtyRect translated(const DirtyRect& rect, const int dx, const int dy) {
+    DirtyRect result;
+    if(!rect.is_empty())
+        result.expand(rect.min_x + dx, rect.min_y + dy, rect.max_x + dx, rect.max_y + dy);
+    return result;
+}
+
+std::size_t SparseWorld::ChunkKeyHash::operator()(const std::uint64_t key) const {
+    return std::size_t(mix_bits(key));
+}
+
+SparseWorld::SparseWorld(const std::uint64_t seed, const int thread_count)
+    : seed_(seed), thread_count_(thread_count) {
+}
+
+std::uint64_t SparseWorld::key_of(const int chunk_x, const int chunk_y) {
+    return std::uint64_t(std::uint32_t(chunk_x)) << 32 | std::uint32_t(chunk_y);
+}
+
+bool SparseWorld::owns(const Island& island, const int chunk_x, const int chunk_y) {
+    return !island.is_tile || (tile_coordinate_of(chunk_x) == island.tile_x &&
+                               tile_coordinate_of(chunk_y) == island.tile_y);
+}
+
+SparseWorld::SparseChunk* SparseWorld::find_chunk(const int chunk_x, const int chunk_y) const {
+    const auto it = chunks_.find(key_of(chunk_x, chunk_y));
+    return it != chunks_.end() ? it->second.get() : nullptr;
+}
+
+void SparseWorld::step(const int ticks) {
+    for(int tick = 0; tick < ticks; ++tick) {
+        find_islands();
+        assign_scratch_grids();
+        tile_stamps_.clear();
+        updated_cell_count_ = 0;
+
+        // The islands are sorted by pass. A pass starts from
+        // the chunks the previous passes stored.
+        for(std::size_t first = 0; first < islands_.size();) {
+            std::size_t last = first;
+            while(last < islands_.size() && islands_[last].pass == islands_[first].pass)
+                ++last;
+
+            if(update_mode_ != UpdateMode::SERIAL && last - first > 1) {
+                thread_pool_->parallel_for(int(last - first), [&](int i) {
+                    simulate_island(islands_[first + i]);
+                });
+            }
+            else {
+                for(std::size_t i = first; i < last; ++i)
+                    simulate_island(islands_[i]);
+            }
+
+            // Chunks are allocated and freed here, which can't
+            // happen while the islands are read by other threads.
+            for(std::size_t i = first; i < last; ++i) {
+                store_island(islands_[i]);
+                updated_cell_count_ += islands_[i].updated_cell_count;
+            }
+            first = last;
+        }
+        ++tick_;
+    }
+}
+
+void SparseWorld::insert(const int x, const int y, const MaterialId material) {
+    if(material == ParticleType::EMPTY)
+        return;
+
+    std::unique_ptr<SparseChunk>& chunk = chunks_[key_of(chunk_coordinate_of(x), chunk_coordinate_of(y))];
+    if(!chunk) {
+        chunk = std::make_unique<SparseChunk>();
+        chunk->cells.materials.fill(ParticleType::EMPTY);
+        chunk->cells.lifetimes.fill(0);
+        chunk->cells.ignition_delays.fill(0);
+        chunk->cells.color_seeds.fill(0);
+    }
+
+    const int i = cell_index_of(x, y);
+    if(chunk->cells.materials[i] != ParticleType::EMPTY)
+        return;
+
+    // Like in a grid, the particles inserted between ticks belong
+    // to the tick that was simulated last, or the first one.
+    const ParticleState state = initial_state_of(material, tick_ > 0 ? tick_ - 1 : 0);
+    chunk->cells.materials[i]       = material;
+    chunk->cells.lifetimes[i]       = state.lifetime;
+    chunk->cells.ignition_delays[i] = state.ignition_delay;
+    chunk->cells.color_seeds[i]     = gen_random_num(0, 255);
+    ++chunk->population;
+    keep_awake(x, y, x, y);
+    are_scratch_grids_stale_ = true;
+}
+
+void SparseWorld::remove(const int x, const int y) {
+    const std::uint64_t key = key_of(chunk_coordinate_of(x), chunk_coordinate_of(y));
+    const auto it = chunks_.find(key);
+    if(it == chunks_.end())
+        return;
+
+    SparseChunk& chunk = *it->second;
+    const int i = cell_index_of(x, y);
+    if(chunk.cells.materials[i] == ParticleType::EMPTY)
+        return;
+
+    chunk.cells.materials[i]       = ParticleType::EMPTY;
+    chunk.cells.lifetimes[i]       = 0;
+    chunk.cells.ignition_delays[i] = 0;
+    chunk.cells.color_seeds[i]     = 0;
+    keep_awake(x, y, x, y);
+    are_scratch_grids_stale_ = true;
+
+    if(--chunk.population == 0)
+        chunks_.erase(it);
+}
+
+void SparseWorld::clear() {
+    chunks_.clear();
+    are_scratch_grids_stale_ = true;
+}
+
+MaterialId SparseWorld::at(const int x, const int y) const {
+    const SparseChunk* chunk = find_chunk(chunk_coordinate_of(x), chunk_coordinate_of(y));
+    return chunk ? chunk->cells.materials[cell_index_of(x, y)] : MaterialId(ParticleType::EMPTY);
+}
+
+int SparseWorld::count() const {
+    int count = 0;
+    for(const auto& entry: chunks_)
+        count += entry.second->population;
+    return count;
+}
+
+int SparseWorld::count_of(const MaterialId material) const {
+    int count = 0;
+    for(const auto& entry: chunks_)
+        count += int(std::count(entry.second->cells.materials.begin(),
+                                entry.second->cells.materials.end(), material));
+    return count;
+}
+
+int SparseWorld::get_chunk_count() const {
+    return int(chunks_.size());
+}
+
+int SparseWorld::get_awake_chunk_count() const {
+    return awake_chunk_count_;
+}
+
+int SparseWorld::get_island_count() const {
+    return int(islands_.size());
+}
+
+std::uint64_t SparseWorld::get_updated_cell_count() const {
+    return updated_cell_count_;
+}
+
+std::uint64_t SparseWorld::get_tick() const {
+    return tick_;
+}
+
+void SparseWorld::set_update_mode(const UpdateMode mode) {
+    if(mode != UpdateMode::SERIAL && !thread_pool_)
+        thread_pool_ = std::make_unique<ThreadPool>(thread_count_);
+    update_mode_ = mode;
+}
+
+UpdateMode SparseWorld::get_update_mode() const {
+    return update_mode_;
+}
+
+void SparseWorld::keep_awake(const int x0, const int y0, const int x1, const int y1) {
+    const int min_x = x0 - 1, min_y = y0 - 1;
+    const int max_x = x1 + 1, max_y = y1 + 1;
+
+    for(int chunk_y = chunk_coordinate_of(min_y); chunk_y <= chunk_coordinate_of(max_y); ++chunk_y) {
+        for(int chunk_x = chunk_coordinate_of(min_x); chunk_x <= chunk_coordinate_of(max_x); ++chunk_x) {
+            SparseChunk* chunk = find_chunk(chunk_x, chunk_y);
+            if(!chunk)
+                continue;
+
+            const int left = chunk_x * CHUNK_SIZE, bottom = chunk_y * CHUNK_SIZE;
+            chunk->wake_rect.expand(std::max(min_x, left),
+                                    std::max(min_y, bottom),
+                                    std::min(max_x, left + CHUNK_SIZE - 1),
+                                    std::min(max_y, bottom + CHUNK_SIZE - 1));
+        }
+    }
+}
+
+void SparseWorld::find_islands() {
+    struct ChunkPosition {
+        int x, y;
+    };
+
+    // Sorted so the islands come out in the same order every time.
+    std::vector<ChunkPosition> awake;
+    for(const auto& entry: chunks_) {
+        SparseChunk& chunk = *entry.second;
+        chunk.rect      = chunk.wake_rect;
+        chunk.wake_rect = DirtyRect();
+        if(!chunk.rect.is_empty() || chunk.has_due_timer(tick_))
+            awake.push_back({int(std::uint32_t(entry.first >> 32)), int(std::uint32_t(entry.first))});
+    }
+    std::sort(awake.begin(), awake.end(), [](const ChunkPosition& a, const ChunkPosition& b) {
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    });
+    awake_chunk_count_ = int(awake.size());
+
+    // Awake chunks that are at most two chunks apart would share a chunk
+    // of their margins, so they belong to the same island.
+    std::unordered_map<std::uint64_t, int, ChunkKeyHash> index_of;
+    for(int i = 0; i < int(awake.size()); ++i)
+        index_of[key_of(awake[i].x, awake[i].y)] = i;
+
+    std::vector<int> parents(awake.size());
+    std::iota(parents.begin(), parents.end(), 0);
+    auto find_root = [&](int i) {
+        while(parents[i] != i)
+            i = parents[i] = parents[parents[i]];
+        return i;
+    };
+
+    for(int i = 0; i < int(awake.size()); ++i) {
+        for(int dy = -2; dy <= 2; ++dy) {
+            for(int dx = -2; dx <= 2; ++dx) {
+                const auto it = index_of.find(key_of(awake[i].x + dx, awake[i].y + dy));
+                if(it != index_of.end())
+                    parents[find_root(it->second)] = find_root(i);
+            }
+        }
+    }
+
+    // The awake chunks of every island are kept for splitting it.
+    islands_.clear();
+    std::vector<std::vector<ChunkPosition>> members;
+    std::vector<int> island_of_root(awake.size(), -1);
+    for(int i = 0; i < int(awake.size()); ++i) {
+        const int root = find_root(i);
+        if(island_of_root[root] < 0) {
+            island_of_root[root] = int(islands_.size());
+            islands_.push_back({awake[i].x - 1, awake[i].y - 1, awake[i].x + 1, awake[i].y + 1});
+            members.emplace_back();
+        }
+
+        members[island_of_root[root]].push_back(awake[i]);
+        Island& island = islands_[island_of_root[root]];
+        island.min_x = std::min(island.min_x, awake[i].x - 1);
+        island.min_y = std::min(island.min_y, awake[i].y - 1);
+        island.max_x = std::max(island.max_x, awake[i].x + 1);
+        island.max_y = std::max(island.max_y, awake[i].y + 1);
+    }
+
+    // The boxes of separate groups can still overlap, like the
+    // boxes of two L shapes, which merges them into one island.
+    bool has_merged = true;
+    while(has_merged) {
+        has_merged = false;
+        for(std::size_t i = 0; i < islands_.size() && !has_merged; ++i) {
+            for(std::size_t j = i + 1; j < islands_.size(); ++j) {
+                Island& a = islands_[i];
+                const Island& b = islands_[j];
+                if(a.max_x < b.min_x || b.max_x < a.min_x || a.max_y < b.min_y || b.max_y < a.min_y)
+                    continue;
+
+                a.min_x = std::min(a.min_x, b.min_x);
+                a.min_y = std::min(a.min_y, b.min_y);
+                a.max_x = std::max(a.max_x, b.max_x);
+                a.max_y = std::max(a.max_y, b.max_y);
+                members[i].insert(members[i].end(), members[j].begin(), members[j].end());
+                islands_.erase(islands_.begin() + j);
+                members.erase(members.begin() + j);
+                has_merged = true;
+                break;
+            }
+        }
+    }
+
+    // A tile holds the awake chunks of the island within it, so its box is
+    // at most a chunk larger than the tile on every side. The tiles of the
+    // same pass are every other tile in both directions.
+    std::vector<Island> boxes = std::move(islands_);
+    islands_.clear();
+    std::unordered_map<std::uint64_t, int, ChunkKeyHash> island_of_tile;
+    for(std::size_t i = 0; i < boxes.size(); ++i) {
+        const Island& box = boxes[i];
+        const int area = (box.max_x - box.min_x + 1) * (box.max_y - box.min_y + 1);
+        if(area <= MAX_ISLAND_CHUNKS && area <= 9 * int(members[i].size())) {
+            islands_.push_back(box);
+            continue;
+        }
+
+        island_of_tile.clear();
+        for(const ChunkPosition& position: members[i]) {
+            const int tile_x = tile_coordinate_of(position.x), tile_y = tile_coordinate_of(position.y);
+            const auto inserted = island_of_tile.emplace(key_of(tile_x, tile_y), int(islands_.size()));
+            if(inserted.second) {
+                Island tile{position.x - 1, position.y - 1, position.x + 1, position.y + 1};
+                tile.is_tile = true;
+                tile.tile_x  = tile_x;
+                tile.tile_y  = tile_y;
+                tile.pass    = (tile_x & 1) | (tile_y & 1) << 1;
+                islands_.push_back(tile);
+            }
+
+            Island& tile = islands_[inserted.first->second];
+            tile.min_x = std::min(tile.min_x, position.x - 1);
+            tile.min_y = std::min(tile.min_y, position.y - 1);
+            tile.max_x = std::max(tile.max_x, position.x + 1);
+            tile.max_y = std::max(tile.max_y, position.y + 1);
+        }
+    }
+
+    std::stable_sort(islands_.begin(), islands_.end(), [](const Island& a, const Island& b) {
+        return a.pass < b.pass;
+    });
+}
+
+void SparseWorld::assign_scratch_grids() {
+    std::vector<ScratchGrid> previous = std::move(scratch_grids_);
+    scratch_grids_.clear();
+    scratch_grids_.reserve(islands_.size());
+
+    auto take = [&](Island& island, ScratchGrid& scratch) {
+        island.grid       = scratch.grid.get();
+        island.simulation = scratch.simulation.get();
+        if(island.is_tile)
+            scratch_grids_.push_back({0, 0, -1, -1, std::move(scratch.grid), std::move(scratch.simulation)});
+        else
+            scratch_grids_.push_back({island.min_x, island.min_y, island.max_x, island.max_y,
+                                      std::move(scratch.grid), std::move(scratch.simulation)});
+    };
+
+    // The tiles share chunks with their neighbors, which change them after
+    // they are stored, so their grids never match the world afterwards.
+    for(Island& island: islands_) {
+        island.grid = nullptr;
+        island.needs_loading = true;
+        if(are_scratch_grids_stale_ || island.is_tile)
+            continue;
+
+        for(ScratchGrid& scratch: previous) {
+            if(scratch.grid && scratch.min_x == island.min_x && scratch.min_y == island.min_y &&
+               scratch.max_x == island.max_x && scratch.max_y == island.max_y) {
+                take(island, scratch);
+                island.needs_loading = false;
+                break;
+            }
+        }
+    }
+
+    // The boxes grow a chunk at a time while particles spread, so the
+    // grids are a little larger than needed and the smallest one that
+    // fits is reused. The chunks past the box stay empty.
+    for(Island& island: islands_) {
+        if(island.grid)
+            continue;
+
+        const int width  = (island.max_x - island.min_x + 1) * CHUNK_SIZE;
+        const int height = (island.max_y - island.min_y + 1) * CHUNK_SIZE;
+        ScratchGrid* best = nullptr;
+        for(ScratchGrid& scratch: previous) {
+            if(!scratch.grid || scratch.grid->get_width() < width || scratch.grid->get_height() < height)
+                continue;
+            if(!best || scratch.grid->get_width() * scratch.grid->get_height() <
+                        best->grid->get_width() * best->grid->get_height())
+                best = &scratch;
+        }
+
+        if(best) {
+            take(island, *best);
+        }
+        else {
+            const int rounding = SCRATCH_GRID_ROUNDING * CHUNK_SIZE;
+            std::unique_ptr<Grid> grid = std::make_unique<Grid>((width + rounding - 1) / rounding * rounding,
+                                                                (height + rounding - 1) / rounding * rounding);
+            std::unique_ptr<Simulation> simulation = std::make_unique<Simulation>(*grid);
+            ScratchGrid scratch{0, 0, 0, 0, std::move(grid), std::move(simulation)};
+            take(island, scratch);
+        }
+    }
+    are_scratch_grids_stale_ = false;
+}
+
+void SparseWorld::simulate_island(Island& island) {
+    Grid& grid = *island.grid;
+    const int columns = grid.get_width() / CHUNK_SIZE;
+    const int rows    = grid.get_height() / CHUNK_SIZE;
+    const int origin_x = island.min_x * CHUNK_SIZE, origin_y = island.min_y * CHUNK_SIZE;
+
+    // A grid that held the box during the previous tick already matches
+    // the world, its rects included, since every change was copied back.
+    if(island.needs_loading) {
+        static const ChunkCells empty_cells = [] {
+            ChunkCells cells;
+            cells.materials.fill(ParticleType::EMPTY);
+            cells.lifetimes.fill(0);
+            cells.ignition_delays.fill(0);
+            cells.color_seeds.fill(0);
+            return cells;
+        }();
+
+        // The loaded cells must not look updated during this tick.
+        grid.begin_tick(tick_);
+
+        // Only the chunks that are awake in the world are simulated,
+        // the rest of the island is there for them to move into.
+        for(int row = 0; row < rows; ++row) {
+            for(int column = 0; column < columns; ++column) {
+                const int index = row * columns + column;
+                const int chunk_x = island.min_x + column, chunk_y = island.min_y + row;
+                const bool is_in_box = chunk_x <= island.max_x && chunk_y <= island.max_y;
+
+                const SparseChunk* chunk = is_in_box ? find_chunk(chunk_x, chunk_y) : nullptr;
+                if(chunk)
+                    grid.copy_chunk_from(index, chunk->cells);
+                else if(!grid.is_chunk_empty(index))
+                    grid.copy_chunk_from(index, empty_cells);
+
+                const bool is_owned = owns(island, chunk_x, chunk_y);
+                if(island.is_tile) {
+                    if(!is_owned)
+                        grid.chunk_timers(index).clear();
+
+                    const auto stamps = tile_stamps_.find(key_of(chunk_x, chunk_y));
+                    if(chunk && stamps != tile_stamps_.end())
+                        grid.copy_chunk_stamps_from(index, stamps->second);
+                }
+
+                Chunk& local_chunk = grid.chunks()[index];
+                local_chunk.rect = DirtyRect();
+                local_chunk.next_rect.store(chunk && is_owned ? translated(chunk->rect, -origin_x, -origin_y) : DirtyRect());
+            }
+        }
+    }
+
+    // The random numbers depend on where the island is, so islands
+    // with the same layout don't move their particles the same way.
+    Simulation& simulation = *island.simulation;
+    simulation.set_seed(hash_seed(seed_, std::uint32_t(island.min_x), std::uint32_t(island.min_y)));
+    simulation.set_tick(tick_);
+    simulation.step();
+    island.updated_cell_count = simulation.get_updated_cell_count();
+}
+
+void SparseWorld::store_island(const Island& island) {
+    const Grid& grid = *island.grid;
+    const int columns = grid.get_width() / CHUNK_SIZE;
+    const int origin_x = island.min_x * CHUNK_SIZE, origin_y = island.min_y * CHUNK_SIZE;
+
+    for(int chunk_y = island.min_y; chunk_y <= island.max_y; ++chunk_y) {
+        for(int chunk_x = island.min_x; chunk_x <= island.max_x; ++chunk_x) {
+            const int index = (chunk_y - island.min_y) * columns + (chunk_x - island.min_x);
+            const Chunk& local_chunk = grid.chunks()[index];
+            const DirtyRect next_rect = local_chunk.next_rect.load();
+
+            // Every change wakes the chunk, the rest didn't change.
+            if(local_chunk.rect.is_empty() && next_rect.is_empty())
+                continue;
+
+            const std::uint64_t key = key_of(chunk_x, chunk_y);
+            const int population = grid.chunk_population(index);
+
+            if(population == 0) {
+                chunks_.erase(key);
+                continue;
+            }
+
+            std::unique_ptr<SparseChunk>& chunk = chunks_[key];
+            if(!chunk)
+                chunk = std::make_unique<SparseChunk>();
+
+            // The timers of the chunks the island doesn't own weren't loaded.
+            std::vector<CellTimer> timers;
+            if(!owns(island, chunk_x, chunk_y))
+                timers = std::move(chunk->cells.timers);
+
+            grid.copy_chunk_to(index, chunk->cells);
+            for(const CellTimer& timer: timers) {
+                chunk->cells.timers.push_back(timer);
+                std::push_heap(chunk->cells.timers.begin(), chunk->cells.timers.end(), CellTimer::is_later);
+            }
+
+            if(island.is_tile)
+                grid.copy_chunk_stamps_to(index, tile_stamps_[key]);
+
+            chunk->population = population;
+            chunk->wake_rect.expand(translated(next_rect, origin_x, origin_y));
+        }
+    }
+}
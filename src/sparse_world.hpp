@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "chunk.hpp"
+#include "grid.hpp"
+#include "simulation.hpp"
+#include "thread_pool.hpp"
+
+// A world without bounds that only stores the chunks holding particles.
+// The chunks are allocated when a particle is placed in them and freed
+// once they're empty, so a huge and mostly empty world only costs memory
+// where the particles are. The cells can be anywhere in the range of int,
+// except within two chunks of its ends.
+//
+// The rules are written for a Grid, so every tick the awake chunks are
+// gathered into islands. An island is a box of chunks around a group of
+// awake chunks, with a margin of one chunk since the particles can reach
+// half a chunk out of their own. The box is copied into a scratch Grid,
+// simulated like a dense world and the chunks that changed are copied
+// back. Islands never share a chunk, so they are simulated independently
+// of each other. The scratch grids are kept, and an island that covers
+// the same box as during the previous tick is simulated without copying.
+//
+// The box around a long diagonal or L shaped group is mostly chunks that
+// nothing reaches, and it grows with the square of the group. An island
+// whose box is too large or too sparse is split into square tiles. The
+// boxes of neighboring tiles share the chunks of their margins, so the
+// tiles are simulated in four passes like the chunks of a grid.
+//
+// A body of liquid is only leveled within the box of the island or tile
+// that asked, see LiquidLeveler, so a sea wider than a tile levels by
+// parts and a body reaching into sleeping chunks past the box waits for
+// its particles there to wake.
+class SparseWorld {
+public:
+    // The scratch grids are sized in multiples of this many chunks.
+    static constexpr int SCRATCH_GRID_ROUNDING = 4;
+
+    // An island is split when its box holds more chunks than this, or more
+    // than the awake chunks and their margins could fill, which is nine
+    // chunks for every awake chunk.
+    static constexpr int MAX_ISLAND_CHUNKS = 256;
+
+    // The width and height of the tiles in chunks. The tiles of a pass are
+    // a tile apart, which is wider than the margins of their boxes.
+    static constexpr int ISLAND_TILE_SIZE = 8;
+
+    // The seed makes the simulation reproducible. A thread_count of 0 uses
+    // one thread per hardware thread when the update mode isn't serial.
+    SparseWorld(const std::uint64_t seed = 0, const int thread_count = 0);
+    SparseWorld(const SparseWorld& other)            = delete;
+    SparseWorld& operator=(const SparseWorld& other) = delete;
+
+    // Advances the world by the number of ticks specified.
+    void step(const int ticks = 1);
+
+    // Places a particle of the material in the cell if it is empty.
+    void insert(const int x, const int y, const MaterialId material);
+    void remove(const int x, const int y);
+
+    // Empties every cell and frees every chunk.
+    void clear();
+
+    // Returns the material stored in the cell.
+    MaterialId at(const int x, const int y) const;
+
+    // Returns the number of particles in the world.
+    int count() const;
+
+    // Returns the number of particles of the material in the world.
+    int count_of(const MaterialId material) const;
+
+    // Returns the number of chunks that are allocated.
+    int get_chunk_count() const;
+
+    // Returns the number of chunks updated during the previous tick.
+    int get_awake_chunk_count() const;
+
+    // Returns the number of islands simulated during the previous tick.
+    int get_island_count() const;
+
+    // Returns the number of particles updated during the previous tick.
+    std::uint64_t get_updated_cell_count() const;
+
+    std::uint64_t get_tick() const;
+
+    // The islands are simulated in parallel unless the mode is serial.
+    // Every island is simulated serially, both give the same result.
+    void set_update_mode(const UpdateMode mode);
+    UpdateMode get_update_mode() const;
+
+private:
+    struct SparseChunk {
+        ChunkCells cells;
+        int population = 0;
+
+        // The cells simulated during the next tick, in world
+        // coordinates. The chunk is asleep when it is empty.
+        DirtyRect wake_rect;
+
+        // The wake_rect of the tick being simulated, which the chunks
+        // simulated in an earlier pass of the tick don't overwrite.
+        DirtyRect rect;
+
+        // Returns true when a particle of the chunk asked to be woken
+        // during the tick, see Grid::wake_at. The chunk is awake then.
+        bool has_due_timer(const std::uint64_t tick) const {
+            return !cells.timers.empty() && cells.timers.front().tick <= tick;
+        }
+    };
+
+    // A box of chunks, in chunk coordinates, simulated in a scratch grid.
+    struct Island {
+        int min_x, min_y, max_x, max_y;
+
+        // A tile only simulates the chunks within it and leaves the rest
+        // of its box, along with their timers, to the neighboring tiles.
+        bool is_tile = false;
+        int tile_x = 0, tile_y = 0;
+        int pass = 0;
+
+        Grid* grid = nullptr;
+        Simulation* simulation = nullptr;
+        bool needs_loading = true; // The grid doesn't hold the chunks of the box yet.
+        std::uint64_t updated_cell_count = 0;
+    };
+
+    // A grid and the box of chunks it held at the end of the previous tick.
+    // The simulation stepping it keeps its buffers between ticks.
+    struct ScratchGrid {
+        int min_x, min_y, max_x, max_y;
+        std::unique_ptr<Grid> grid;
+        std::unique_ptr<Simulation> simulation;
+    };
+
+    struct ChunkKeyHash {
+        std::size_t operator()(const std::uint64_t key) const;
+    };
+
+    using ChunkMap = std::unordered_map<std::uint64_t, std::unique_ptr<SparseChunk>, ChunkKeyHash>;
+
+private:
+    static std::uint64_t key_of(const int chunk_x, const int chunk_y);
+
+    // Returns true when the island simulates the chunk.
+    static bool owns(const Island& island, const int chunk_x, const int chunk_y);
+
+    // Returns the chunk storing the cell, or null when it isn't allocated.
+    SparseChunk* find_chunk(const int chunk_x, const int chunk_y) const;
+
+    // Marks the cells of the rect and their neighbors as changed, like
+    // Grid::keep_awake. Only allocated chunks are woken, since empty
+    // chunks have nothing to simulate.
+    void keep_awake(const int min_x, const int min_y, const int max_x, const int max_y);
+
+    // Groups the awake chunks into islands. Only the tiles of different
+    // passes share chunks.
+    void find_islands();
+
+    // Hands every island a scratch grid, preferring the grid that
+    // already holds its box and then one of the same size.
+    void assign_scratch_grids();
+
+    // Copies the chunks of the island into its scratch grid and steps it.
+    void simulate_island(Island& island);
+
+    // Copies the chunks of the island back, freeing the empty ones.
+    void store_island(const Island& island);
+
+private:
+    std::uint64_t seed_;
+    int thread_count_;
+    std::uint64_t tick_     = 0;
+    UpdateMode update_mode_ = UpdateMode::SERIAL;
+    std::unique_ptr<ThreadPool> thread_pool_;
+
+    ChunkMap chunks_;
+
+    // The islands of the current tick and the grids they are copied into.
+    // The grids are stale once a chunk was changed outside of a tick.
+    std::vector<Island> islands_;
+    std::vector<ScratchGrid> scratch_grids_;
+    bool are_scratch_grids_stale_ = false;
+
+    // The update stamps of the chunks stored by the tiles during the
+    // current tick, so the particles they updated aren't updated again.
+    std::unordered_map<std::uint64_t, std::array<std::uint16_t, ChunkCells::SIZE>, ChunkKeyHash> tile_stamps_;
+
+    int awake_chunk_count_ = 0;
+    std::uint64_t updated_cell_count_ = 0;
+};
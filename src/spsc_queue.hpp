@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// A fixed-size queue that one thread pushes to while another thread pops
+// from it, without locks. Each index is only written by one of the two
+// threads, so a push or a pop is a copy and a pair of atomic accesses.
+template<typename T, std::size_t Capacity>
+class SpscQueue {
+public:
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "The capacity must be a power of two");
+
+public:
+    // Returns false when the queue is full. Only one thread may push.
+    bool push(const T& item) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail - head_.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        items_[tail & (Capacity - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false when the queue is empty. Only one thread may pop.
+    bool pop(T& item) {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if(head == tail_.load(std::memory_order_acquire))
+            return false;
+
+        item = items_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> items_;
+
+    // The indices only grow. They are kept on separate cache
+    // lines since each one is written by a different thread.
+    alignas(64) std::atomic<std::size_t> head_{0}; // The next item to pop.
+    alignas(64) std::atomic<std::size_t> tail_{0}; // The next slot to push to.
+};
@@ -0,0 +1,97 @@
+#include <glad/glad.h>
+
+#include "texture_renderer.hpp"
+
+TextureRenderer::TextureRenderer(const int width, const int height)
+    : width_(width), height_(height),
+      shader_("./shaders/grid.vs", "./shaders/grid.fs") {
+    // The cells are unsigned integers, which can't be filtered.
+    glGenTextures(1, &cells_texture_);
+    glBindTexture(GL_TEXTURE_2D, cells_texture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, width_, height_, 0,
+                 GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // A quad that covers the window, drawn as a triangle strip.
+    float vertices[] = {
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+        -1.0f,  1.0f,
+         1.0f,  1.0f
+    };
+
+    glGenBuffers(1, &vbo_);
+    glGenVertexArrays(1, &vao_);
+
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    shader_.use();
+    shader_.setInt("cells", 0);
+    shader_.setInt("palette", 1);
+}
+
+TextureRenderer::~TextureRenderer() {
+    glDeleteTextures(1, &cells_texture_);
+    glDeleteBuffers(1, &vbo_);
+    glDeleteVertexArrays(1, &vao_);
+}
+
+void TextureRenderer::draw(const Snapshot& snapshot) {
+    glBindTexture(GL_TEXTURE_2D, cells_texture_);
+
+    if(snapshot.sequence != uploaded_sequence_) {
+        // The rects are uploaded straight from the rows of the snapshot.
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, snapshot.width);
+
+        if(needs_full_upload_) {
+            DirtyRect all;
+            all.expand(0, 0, width_ - 1, height_ - 1);
+            upload(snapshot, all);
+            needs_full_upload_ = false;
+        }
+        else {
+            // Sleeping chunks didn't change, which is most of a settled world.
+            for(const DirtyRect& rect: snapshot.changed_rects) {
+                if(!rect.is_empty())
+                    upload(snapshot, rect);
+            }
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        uploaded_sequence_ = snapshot.sequence;
+    }
+
+    shader_.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, cells_texture_);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, palette_.ID);
+
+    glBindVertexArray(vao_);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void TextureRenderer::upload(const Snapshot& snapshot, const DirtyRect& rect) {
+    const int width  = rect.max_x - rect.min_x + 1;
+    const int height = rect.max_y - rect.min_y + 1;
+    const std::uint8_t* first = &snapshot.palette_indices[std::size_t(rect.min_y) * snapshot.width + rect.min_x];
+
+    // The first row of the texture is the bottom row of the grid.
+    glTexSubImage2D(GL_TEXTURE_2D, 0, rect.min_x, rect.min_y, width, height,
+                    GL_RED_INTEGER, GL_UNSIGNED_BYTE, first);
+}
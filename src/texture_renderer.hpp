@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+#include "gl_objects.hpp"
+#include "shader.hpp"
+#include "simulation_thread.hpp"
+
+// Draws the grid as a single texture that stores one byte per cell, the
+// palette index of its particle. The fragment shader looks up the colors
+// in a palette texture, so a frame only uploads the cells that changed.
+class TextureRenderer {
+public:
+    TextureRenderer(const int width, const int height);
+    ~TextureRenderer();
+    TextureRenderer(const TextureRenderer& other)            = delete;
+    TextureRenderer& operator=(const TextureRenderer& other) = delete;
+
+    // Uploads the chunks that changed since the previous snapshot and draws
+    // the grid. Every snapshot that is read must be passed to this.
+    void draw(const Snapshot& snapshot);
+
+    // Uploads the whole grid during the next draw, which is needed
+    // when some snapshots weren't drawn.
+    void invalidate() { needs_full_upload_ = true; }
+
+private:
+    // Copies the palette indices of the cells in the rect into the texture.
+    void upload(const Snapshot& snapshot, const DirtyRect& rect);
+
+private:
+    int width_, height_;
+    unsigned int cells_texture_;
+    PaletteTexture palette_;
+    unsigned int vao_, vbo_;
+    Shader shader_;
+
+    std::uint64_t uploaded_sequence_ = 0;
+    bool needs_full_upload_ = true;
+};
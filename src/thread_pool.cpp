@@ -0,0 +1,76 @@
+#include <algorithm>
+
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(int thread_count) {
+    if(thread_count <= 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    // The calling thread also runs tasks.
+    for(int i = 1; i < thread_count; ++i)
+        threads_.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_all();
+
+    for(std::thread& thread: threads_)
+        thread.join();
+}
+
+void ThreadPool::parallel_for(const int count, const std::function<void(int)>& task) {
+    if(count <= 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_         = &task;
+        task_count_   = count;
+        busy_threads_ = threads_.size();
+        next_index_.store(0);
+        ++generation_;
+    }
+    work_ready_.notify_all();
+
+    run_tasks();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_done_.wait(lock, [this]{ return busy_threads_ == 0; });
+    task_ = nullptr;
+}
+
+int ThreadPool::get_thread_count() const {
+    return threads_.size() + 1;
+}
+
+void ThreadPool::work() {
+    unsigned seen_generation = 0;
+
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_ready_.wait(lock, [&]{ return stopping_ || generation_ != seen_generation; });
+
+            if(stopping_)
+                return;
+            seen_generation = generation_;
+        }
+
+        run_tasks();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(--busy_threads_ == 0)
+            work_done_.notify_one();
+    }
+}
+
+void ThreadPool::run_tasks() {
+    int index;
+
+    while((index = next_index_.fetch_add(1)) < task_count_)
+        (*task_)(index);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that split the iterations of a loop.
+// The threads are started once and sleep while there is no work.
+class ThreadPool {
+public:
+    // A thread_count of 0 uses one thread per hardware thread.
+    explicit ThreadPool(int thread_count = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool& other)            = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    // Calls the task once for every index in [0, count), spread across the
+    // workers and the calling thread. Returns once every call has finished.
+    void parallel_for(const int count, const std::function<void(int)>& task);
+
+    // Returns the number of threads that run tasks, the caller included.
+    int get_thread_count() const;
+
+private:
+    void work();
+    void run_tasks();
+
+private:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable work_ready_;
+    std::condition_variable work_done_;
+
+    const std::function<void(int)>* task_ = nullptr;
+    int task_count_      = 0;
+    int busy_threads_    = 0;
+    unsigned generation_ = 0; // Incremented every time new work is posted.
+    bool stopping_       = false;
+    std::atomic<int> next_index_{0};
+};
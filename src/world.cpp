@@ -0,0 +1,62 @@
+#include "world.hpp"
+
+World::World(const std::uint64_t seed, const int thread_count, const int width, const int height)
+    : grid_(width, height), simulation_(grid_, seed, thread_count) {
+}
+
+void World::step(const int ticks) {
+    for(int i = 0; i < ticks; ++i)
+        simulation_.step();
+}
+
+void World::insert(const int x, const int y, const MaterialId material) {
+    grid_.insert(x, y, material);
+}
+
+void World::remove(const int x, const int y) {
+    grid_.remove(x, y);
+}
+
+void World::clear() {
+    grid_.clear();
+}
+
+MaterialId World::at(const int x, const int y) const {
+    return grid_.at(x, y);
+}
+
+int World::count() const {
+    return grid_.count();
+}
+
+int World::count_of(const MaterialId material) const {
+    return grid_.count_of(material);
+}
+
+int World::get_width() const {
+    return grid_.get_width();
+}
+
+int World::get_height() const {
+    return grid_.get_height();
+}
+
+std::uint64_t World::get_tick() const {
+    return simulation_.get_tick();
+}
+
+Grid& World::get_grid() {
+    return grid_;
+}
+
+const Grid& World::get_grid() const {
+    return grid_;
+}
+
+Simulation& World::get_simulation() {
+    return simulation_;
+}
+
+const Simulation& World::get_simulation() const {
+    return simulation_;
+}
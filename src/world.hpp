@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+#include "grid.hpp"
+#include "simulation.hpp"
+
+// A falling-sand world that can be created, stepped and inspected without
+// a window. It owns the grid of particles and the simulation advancing it,
+// and has no windowing or graphics dependencies.
+class World {
+public:
+    // The seed makes the simulation reproducible. A thread_count
+    // of 0 uses one thread per hardware thread in parallel mode.
+    // The size is in cells.
+    World(const std::uint64_t seed = 0, const int thread_count = 0,
+          const int width = DEFAULT_WIDTH, const int height = DEFAULT_HEIGHT);
+    World(const World& other)            = delete;
+    World& operator=(const World& other) = delete;
+
+    // Advances the world by the number of ticks specified.
+    void step(const int ticks = 1);
+
+    // Places a particle of the material in the cell if it is empty.
+    void insert(const int x, const int y, const MaterialId material);
+    void remove(const int x, const int y);
+
+    // Empties every cell.
+    void clear();
+
+    // Returns the material stored in the cell.
+    MaterialId at(const int x, const int y) const;
+
+    // Returns the number of particles in the world.
+    int count() const;
+
+    // Returns the number of particles of the material in the world.
+    int count_of(const MaterialId material) const;
+
+    int get_width() const;
+    int get_height() const;
+    std::uint64_t get_tick() const;
+
+    Grid& get_grid();
+    const Grid& get_grid() const;
+    Simulation& get_simulation();
+    const Simulation& get_simulation() const;
+
+private:
+    Grid grid_;
+    Simulation simulation_;
+};
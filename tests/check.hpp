@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+// The tests are plain executables run by ctest. A check that fails prints
+// where it is and the test carries on, so a run reports every failure.
+inline int& failed_check_count() {
+    static int count = 0;
+    return count;
+}
+
+#define CHECK(condition)                                                             \
+    do {                                                                             \
+        if(!(condition)) {                                                           \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": failed " #condition "\n"; \
+            ++failed_check_count();                                                  \
+        }                                                                            \
+    } while(false)
+
+// Returns the exit code of the test.
+inline int test_result() {
+    return failed_check_count() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
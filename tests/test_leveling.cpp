@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "check.hpp"
+#include "particle_types.hpp"
+#include "random.hpp"
+#include "world.hpp"
+
+// Returns the row above the highest water particle of the column.
+static int surface_of(const World& world, const int x) {
+    for(int y = world.get_height() - 1; y >= 0; --y) {
+        if(world.at(x, y) == ParticleType::WATER)
+            return y + 1;
+    }
+    return 0;
+}
+
+static void fill(World& world, const int min_x, const int min_y, const int max_x, const int max_y,
+                 const MaterialId material) {
+    for(int y = min_y; y <= max_y; ++y) {
+        for(int x = min_x; x <= max_x; ++x)
+            world.insert(x, y, material);
+    }
+}
+
+// The water poured into one arm of a U-tube flows under the wall between
+// the arms and rises in the other one until both are level. The water
+// is neither lost nor duplicated on the way.
+static void check_u_tube(const UpdateMode mode) {
+    seed_random(3);
+    World world(3, 4, 200, 160);
+    world.get_simulation().set_update_mode(mode);
+
+    fill(world,  18,  8, 103,   9, ParticleType::WALL);
+    fill(world,  18, 10,  19, 150, ParticleType::WALL);
+    fill(world, 102, 10, 103, 150, ParticleType::WALL);
+    fill(world,  41, 21,  79, 150, ParticleType::WALL);
+    fill(world,  20, 21,  40, 140, ParticleType::WATER);
+
+    const int water = world.count_of(ParticleType::WATER);
+    bool is_conserved = true;
+    for(int tick = 0; tick < 1500; ++tick) {
+        world.step();
+        is_conserved = is_conserved && world.count_of(ParticleType::WATER) == water;
+    }
+    CHECK(is_conserved);
+
+    // The channel holds 82 * 11 particles, and the arms 21 and 22 columns.
+    const int level = 10 + 11 + (water - 82 * 11) / (21 + 22);
+    for(const int x: {20, 30, 40, 80, 90, 101})
+        CHECK(std::abs(surface_of(world, x) - level) <= 2);
+}
+
+// Water dropped onto a basin spreads into a flat pool.
+static void check_pool() {
+    seed_random(4);
+    World world(4, 4, 256, 128);
+
+    fill(world, 10, 4, 245, 5, ParticleType::WALL);
+    fill(world, 10, 6, 11, 60, ParticleType::WALL);
+    fill(world, 244, 6, 245, 60, ParticleType::WALL);
+    for(int i = 0; i < 12; ++i)
+        fill(world, 20 + i * 18, 60 + i % 4 * 10, 27 + i * 18, 70 + i % 4 * 10, ParticleType::WATER);
+
+    const int water = world.count_of(ParticleType::WATER);
+    bool is_conserved = true;
+    for(int tick = 0; tick < 800; ++tick) {
+        world.step();
+        is_conserved = is_conserved && world.count_of(ParticleType::WATER) == water;
+    }
+    CHECK(is_conserved);
+
+    int min_surface = world.get_height(), max_surface = 0;
+    for(int x = 12; x <= 243; ++x) {
+        min_surface = std::min(min_surface, surface_of(world, x));
+        max_surface = std::max(max_surface, surface_of(world, x));
+    }
+    CHECK(max_surface - min_surface <= 1);
+}
+
+// Water released at the end of a sealed tunnel one cell tall, which has
+// no surface to level, spreads along it on its own.
+static void check_tunnel() {
+    seed_random(5);
+    World world(5, 4, 256, 64);
+
+    fill(world, 10, 20, 200, 20, ParticleType::WALL);
+    fill(world, 10, 22, 200, 22, ParticleType::WALL);
+    fill(world, 10, 21, 10, 21, ParticleType::WALL);
+    fill(world, 200, 21, 200, 21, ParticleType::WALL);
+    fill(world, 11, 21, 26, 21, ParticleType::WATER);
+
+    const int water = world.count_of(ParticleType::WATER);
+    world.step(3000);
+    CHECK(world.count_of(ParticleType::WATER) == water);
+
+    int farthest = 0;
+    for(int x = 11; x < 200; ++x) {
+        if(world.at(x, 21) == ParticleType::WATER)
+            farthest = x;
+    }
+    CHECK(farthest > 100);
+}
+
+int main() {
+    check_u_tube(UpdateMode::SERIAL);
+    check_u_tube(UpdateMode::PARALLEL);
+    check_pool();
+    check_tunnel();
+    return test_result();
+}
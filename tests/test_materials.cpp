@@ -0,0 +1,143 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "default_materials.hpp"
+#include "material.hpp"
+#include "particle_types.hpp"
+
+// A few materials that use every property.
+static const std::string VALID = R"(crumble-materials 1
+# A comment.
+material Water  
+phase liquid
+density 1000
+dispersion 5   # Another comment.
+color 0 0 0.9 0 0 1
+reaction Fire Steam none
+
+material Steam
+phase gas
+density 1
+lifetime 500
+movement up 60 up_left 20 up_right 20
+color 0.8 0.8 0.8 0.9 0.9 0.9
+
+material Fire
+phase plasma
+density 1
+lifetime 120
+ignition_delay 4
+spread 40
+color 1 0.5 0 1 0 0
+)";
+
+static bool parses(const std::string& text, std::vector<MaterialDefinition>& definitions) {
+    std::istringstream stream(text);
+    return parse_materials(stream, "the test", definitions);
+}
+
+static bool parses(const std::string& text) {
+    std::vector<MaterialDefinition> definitions;
+    return parses(text, definitions);
+}
+
+// Returns whether the text parses and the definitions are valid. The
+// registry of the test starts with the default materials and is left
+// alone, the one of the worlds included.
+static bool defines(const std::string& text) {
+    std::vector<MaterialDefinition> definitions;
+    MaterialRegistry registry;
+    return parses(text, definitions) && registry.define(definitions);
+}
+
+// Returns the valid text with the line that starts with the prefix
+// replaced by another one, which can hold several lines.
+static std::string replace_line(const std::string& prefix, const std::string& line) {
+    const std::size_t start = VALID.find(prefix);
+    const std::size_t end   = VALID.find('\n', start);
+    return VALID.substr(0, start) + line + VALID.substr(end);
+}
+
+static void check_valid() {
+    std::vector<MaterialDefinition> definitions;
+    CHECK(parses(VALID, definitions) && definitions.size() == 3);
+    CHECK(defines(VALID));
+
+    const MaterialDefinition& water = definitions.at(0);
+    CHECK(water.name == "Water" && water.phase == Phase::LIQUID);
+    CHECK(water.density == 1000 && water.dispersion_rate == 5);
+    CHECK(water.reactions.size() == 1 && water.reactions[0].product == "Steam" && water.reactions[0].chance == 100);
+    CHECK(definitions.at(1).movement.size() == 3 && definitions.at(1).lifetime == 500);
+    CHECK(definitions.at(2).ignition_delay == 4 && definitions.at(2).spread_chance == 40);
+
+    CHECK(defines(replace_line("reaction", "reaction Fire Steam none 25")));
+
+    MaterialRegistry registry;
+    std::vector<MaterialDefinition> defaults;
+    CHECK(parses(DEFAULT_MATERIALS, defaults) && registry.define(defaults));
+    CHECK(registry.get_count() == ParticleType::COUNT);
+    CHECK(registry.get_fingerprint() == material_registry().get_fingerprint());
+}
+
+// The text isn't a definition file.
+static void check_syntax_errors() {
+    CHECK(!parses(""));
+    CHECK(!parses("crumble-material 1\n"));
+    CHECK(!parses("crumble-materials 2\n"));
+    CHECK(!parses("crumble-materials 1\nphase solid\n"));
+    CHECK(!parses(replace_line("material Water", "material")));
+    CHECK(!parses(replace_line("density 1000", "density")));
+    CHECK(!parses(replace_line("density 1000", "density heavy")));
+    CHECK(!parses(replace_line("density 1000", "density 1000 2000")));
+    CHECK(!parses(replace_line("density 1000", "weight 1000")));
+    CHECK(!parses(replace_line("phase liquid", "phase slime")));
+    CHECK(!parses(replace_line("color 0 0 0.9", "color 0 0 0.9 0 0")));
+    CHECK(!parses(replace_line("reaction", "reaction Fire Steam")));
+    CHECK(!parses(replace_line("reaction", "reaction Fire Steam none often")));
+    CHECK(!parses(replace_line("reaction", "reaction Fire Steam none 25 50")));
+    CHECK(!parses(replace_line("movement", "movement")));
+    CHECK(!parses(replace_line("movement", "movement up")));
+    CHECK(!parses(replace_line("movement", "movement sideways 10")));
+}
+
+// The text parses but the definitions can't be compiled.
+static void check_invalid_definitions() {
+    CHECK(!defines("crumble-materials 1\n"));
+    CHECK(!defines(replace_line("phase liquid", "")));
+    CHECK(!defines(replace_line("density 1000", "density -1")));
+    CHECK(!defines(replace_line("dispersion", "dispersion " + std::to_string(MaterialRegistry::MAX_DISPERSION_RATE + 1))));
+    CHECK(!defines(replace_line("lifetime 500", "lifetime 0")));
+    CHECK(!defines(replace_line("lifetime 500", "lifetime 40000")));
+    CHECK(!defines(replace_line("ignition_delay", "ignition_delay 0")));
+    CHECK(!defines(replace_line("ignition_delay", "ignition_delay 128")));
+    CHECK(!defines(replace_line("spread", "spread 101")));
+    CHECK(!defines(replace_line("color 0 0 0.9", "color 0 0 1.5 0 0 1")));
+    CHECK(!defines(replace_line("movement", "movement up -10 up_left 20")));
+    CHECK(!defines(replace_line("movement", "movement up 0")));
+
+    const int max_weight = MaterialRegistry::MAX_MOVEMENT_WEIGHT;
+    CHECK(defines(replace_line("movement", "movement up " + std::to_string(max_weight))));
+    CHECK(!defines(replace_line("movement", "movement up " + std::to_string(max_weight) + " up_left 1")));
+    CHECK(!defines(replace_line("movement", "movement up 2000000000 up_left 2000000000")));
+
+    CHECK(!defines(VALID + "material Fire\nphase solid\n"));
+    CHECK(!defines(replace_line("reaction", "reaction Fire Ice none")));
+    CHECK(!defines(replace_line("reaction", "reaction Fire Steam Ice")));
+    CHECK(!defines(replace_line("reaction", "reaction Steam Steam none")));
+    CHECK(!defines(replace_line("reaction", "reaction Fire Steam none 0")));
+    CHECK(!defines(replace_line("reaction", "reaction Fire Steam none\nreaction Fire none none")));
+
+    std::string many = "crumble-materials 1\n";
+    for(int i = 0; i < MaterialRegistry::MAX_COUNT; ++i)
+        many += "material Wall" + std::to_string(i) + "\nphase solid\n";
+    CHECK(!defines(many));
+}
+
+int main() {
+    check_valid();
+    check_syntax_errors();
+    check_invalid_definitions();
+    return test_result();
+}
@@ -0,0 +1,142 @@
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "check.hpp"
+#include "material.hpp"
+#include "particle_types.hpp"
+#include "random.hpp"
+#include "recording.hpp"
+
+static const std::string PATH = "test.rec";
+static const std::string BAD_PATH = "bad.rec";
+
+static std::string read_file(const std::string& path) {
+    std::ifstream file(path);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+static void write_file(const std::string& path, const std::string& text) {
+    std::ofstream file(path, std::ios::trunc);
+    file << text;
+}
+
+// Returns the text with the first line that starts with the prefix
+// replaced, or removed when the line is empty.
+static std::string replace_line(const std::string& text, const std::string& prefix, const std::string& line) {
+    const std::size_t start = text.find(prefix);
+    const std::size_t end   = text.find('\n', start) + 1;
+    return text.substr(0, start) + (line.empty() ? "" : line + '\n') + text.substr(end);
+}
+
+// Paints strokes of every material into a world for a few hundred ticks,
+// clearing it halfway, and records the commands like SimulationThread.
+static Recording record(World& world) {
+    Recording recording;
+    recording.width  = world.get_width();
+    recording.height = world.get_height();
+    recording.seed   = world.get_simulation().get_seed();
+    recording.material_fingerprint = material_registry().get_fingerprint();
+    recording.random = thread_random().get_state();
+
+    for(int i = 0; i < 300; ++i) {
+        RecordedCommand recorded;
+        recorded.tick = world.get_tick();
+
+        BrushCommand& command = recorded.command;
+        if(i == 150) {
+            command.kind = BrushKind::CLEAR;
+        }
+        else {
+            command.shape    = BrushShape(i % 2);
+            command.material = MaterialId(1 + i % (ParticleType::COUNT - 1));
+            command.size     = 1 + i % 4;
+            command.x0 = (i * 37) % world.get_width();
+            command.y0 = 100 + (i * 11) % 50;
+            command.x1 = command.x0 + 5;
+            command.y1 = command.y0 - 3;
+        }
+        apply_brush_command(command, world.get_grid());
+        recording.commands.push_back(recorded);
+
+        if(i % 3 == 0)
+            world.step();
+    }
+    world.step(100);
+    recording.end_tick = world.get_tick();
+    return recording;
+}
+
+// Replaying a recording simulates the same ticks as the session,
+// whatever the update mode or the number of threads.
+static void check_replay(const Recording& recording, const World& recorded) {
+    Recording loaded;
+    CHECK(save_recording(recording, PATH));
+    CHECK(load_recording(PATH, loaded));
+    CHECK(loaded.commands.size() == recording.commands.size());
+    CHECK(loaded.end_tick == recording.end_tick);
+
+    thread_random().set_state(Random::State());
+    World world(loaded.seed, 4, loaded.width, loaded.height);
+    world.get_simulation().set_update_mode(UpdateMode::PARALLEL);
+
+    RecordingPlayer player(loaded);
+    player.start();
+    while(!player.is_finished(world)) {
+        player.apply_commands(world);
+        world.step();
+    }
+    CHECK(world.get_tick() == recorded.get_tick());
+    CHECK(world.get_grid().save_state() == recorded.get_grid().save_state());
+}
+
+// A file that isn't a valid recording is refused.
+static void check_rejections() {
+    const std::string text = read_file(PATH);
+    Recording loaded;
+
+    write_file(BAD_PATH, replace_line(text, "crumble-recording", "crumble-recording 1"));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, replace_line(text, "size", "size 0 100"));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, replace_line(text, "random", "random 1 2 65"));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, replace_line(text, "materials", "materials 1"));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, replace_line(text, "paint", "paint 0 0 1 " + std::to_string(MAX_BRUSH_SIZE + 1) + " 0 0 0 0"));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, replace_line(text, "paint", "paint 0 0 1 1 0 0 0 " + std::to_string(MAX_BRUSH_COORDINATE + 1)));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, replace_line(text, "paint", "paint 0 0 " + std::to_string(ParticleType::COUNT) + " 1 0 0 0 0"));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, replace_line(text, "paint", "paint"));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, text + "paint 0 0 1 1 0 0 0 0\n");
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, replace_line(text, "end", ""));
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    write_file(BAD_PATH, text + "jump 10\n");
+    CHECK(!load_recording(BAD_PATH, loaded));
+
+    CHECK(!load_recording("missing.rec", loaded));
+}
+
+int main() {
+    seed_random(5);
+    World world(5, 1, 200, 150);
+    const Recording recording = record(world);
+
+    check_replay(recording, world);
+    check_rejections();
+    return test_result();
+}
@@ -0,0 +1,120 @@
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "default_materials.hpp"
+#include "material.hpp"
+#include "particle_types.hpp"
+#include "random.hpp"
+#include "scenarios.hpp"
+#include "snapshot.hpp"
+
+static const std::string PATH = "test.snap";
+static const std::string BAD_PATH = "bad.snap";
+
+// The stamps and the rects only tell what the last tick did, a snapshot
+// keeps what the next one needs.
+static GridState state_of(const World& world) {
+    GridState state = world.get_grid().save_state();
+    state.update_stamps.clear();
+    state.rects.clear();
+    return state;
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+static void write_file(const std::string& path, const std::string& data) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), std::streamsize(data.size()));
+}
+
+// A world loaded from a snapshot continues like the world that was saved,
+// whatever its seed, its threads and its update mode.
+static void check_round_trip(const Scenario& scenario, const int width, const int height) {
+    seed_random(7);
+    World saved(7, 1, width, height);
+    scenario.setup(saved);
+    saved.step(100);
+    CHECK(save_snapshot(saved, PATH));
+
+    SnapshotInfo info;
+    CHECK(read_snapshot_info(PATH, info));
+    CHECK(info.version == SNAPSHOT_VERSION && info.width == width && info.height == height);
+    CHECK(info.seed == 7 && info.tick == saved.get_tick());
+
+    seed_random(99);
+    World loaded(3, 4, width, height);
+    loaded.get_simulation().set_update_mode(UpdateMode::PARALLEL);
+    CHECK(load_snapshot(loaded, PATH));
+    CHECK(state_of(loaded) == state_of(saved));
+
+    saved.step(100);
+    loaded.step(100);
+    CHECK(state_of(loaded) == state_of(saved));
+}
+
+// A file that isn't a valid snapshot for the world is refused, and
+// the world is left unchanged.
+static void check_rejections() {
+    seed_random(7);
+    World saved(7, 1, 97, 110);
+    get_scenarios().front().setup(saved);
+    saved.step(50);
+    CHECK(save_snapshot(saved, PATH));
+    const std::string data = read_file(PATH);
+
+    World world(0, 1, 97, 110);
+    world.insert(10, 10, ParticleType::WALL);
+    const GridState initial = state_of(world);
+
+    for(const std::size_t size: {std::size_t(3), std::size_t(40), data.size() / 2, data.size() - 1}) {
+        write_file(BAD_PATH, data.substr(0, size));
+        CHECK(!load_snapshot(world, BAD_PATH));
+    }
+
+    std::string garbled = data;
+    for(std::size_t i = 64; i < garbled.size(); i += 7)
+        garbled[i] ^= 0x5a;
+    write_file(BAD_PATH, garbled);
+    CHECK(!load_snapshot(world, BAD_PATH));
+
+    std::string version = data;
+    version[8] ^= 1;
+    write_file(BAD_PATH, version);
+    CHECK(!load_snapshot(world, BAD_PATH));
+
+    CHECK(!load_snapshot(world, "missing.snap"));
+    CHECK(state_of(world) == initial);
+
+    World other_size(0, 1, 100, 100);
+    CHECK(!load_snapshot(other_size, PATH));
+
+    // The same file is refused once the materials change.
+    std::istringstream stream(DEFAULT_MATERIALS);
+    std::vector<MaterialDefinition> definitions;
+    CHECK(parse_materials(stream, "the default materials", definitions));
+    std::vector<MaterialDefinition> heavier_sand = definitions;
+    heavier_sand[ParticleType::SAND - 1].density += 1;
+
+    CHECK(material_registry().define(heavier_sand));
+    CHECK(!load_snapshot(world, PATH));
+    CHECK(material_registry().define(definitions));
+    CHECK(load_snapshot(world, PATH));
+}
+
+int main() {
+    for(const Scenario& scenario: get_scenarios()) {
+        if(!scenario.sparse_setup) {
+            check_round_trip(scenario, 550, 563);
+            check_round_trip(scenario, 97, 110);
+        }
+    }
+    check_rejections();
+    return test_result();
+}
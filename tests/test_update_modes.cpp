@@ -0,0 +1,105 @@
+#include <functional>
+#include <vector>
+
+#include "check.hpp"
+#include "particle_types.hpp"
+#include "random.hpp"
+#include "scenarios.hpp"
+
+// The scenarios are cut short, the first ticks are the busiest.
+static const int TICKS = 150;
+
+// Runs the scenario in the mode and returns the state it ends in.
+static GridState run(const Scenario& scenario, const UpdateMode mode) {
+    seed_random(1);
+    World world(1, 4);
+    world.get_simulation().set_update_mode(mode);
+    scenario.setup(world);
+    world.step(TICKS);
+    return world.get_grid().save_state();
+}
+
+// A staircase of ledges holding sand and water, which spans more chunks
+// than an island can and is split into tiles.
+static void set_up_staircase(SparseWorld& world) {
+    for(int step = 0; step < 40; ++step) {
+        const int x = step * CHUNK_SIZE, y = 2000 - step * CHUNK_SIZE;
+        for(int i = 0; i < 24; ++i)
+            world.insert(x + i, y, ParticleType::WALL);
+        for(int j = 1; j <= 10; ++j) {
+            for(int i = 4; i < 20; ++i)
+                world.insert(x + i, y + j, (i + j) % 3 == 0 ? ParticleType::WATER : ParticleType::SAND);
+        }
+    }
+}
+
+// A region of a sparse world, the cells from the minimum to the maximum.
+struct Region {
+    int min_x, min_y, max_x, max_y;
+};
+
+// The sites of sparse_islands, see bench/scenarios.cpp, with room for
+// the sand and water to fall onto the floor of their basin and spill.
+static std::vector<Region> get_island_regions() {
+    const int spacing = 32768;
+    std::vector<Region> regions;
+    for(int site_y = 0; site_y < 8; ++site_y) {
+        for(int site_x = 0; site_x < 8; ++site_x) {
+            const int x = site_x * spacing, y = site_y * spacing;
+            regions.push_back({x - 128, y - 384, x + 192, y + 96});
+        }
+    }
+    return regions;
+}
+
+// Runs the sparse world serially and in parallel and compares the cells
+// of the regions, which must hold every particle.
+static void check_sparse_modes(const std::function<void(SparseWorld&)>& setup,
+                               const std::vector<Region>& regions) {
+    SparseWorld serial(1, 4), parallel(1, 4);
+    parallel.set_update_mode(UpdateMode::PARALLEL);
+    seed_random(1);
+    setup(serial);
+    seed_random(1);
+    setup(parallel);
+
+    for(int tick = 0; tick < TICKS; ++tick) {
+        serial.step();
+        parallel.step();
+        CHECK(serial.get_updated_cell_count() == parallel.get_updated_cell_count());
+    }
+
+    int different_cells = 0, particles = 0;
+    for(const Region& region: regions) {
+        for(int y = region.min_y; y <= region.max_y; ++y) {
+            for(int x = region.min_x; x <= region.max_x; ++x) {
+                different_cells += serial.at(x, y) != parallel.at(x, y);
+                particles += serial.at(x, y) != ParticleType::EMPTY;
+            }
+        }
+    }
+    CHECK(different_cells == 0);
+    CHECK(particles == serial.count());
+    for(int material = 1; material < ParticleType::COUNT; ++material)
+        CHECK(serial.count_of(MaterialId(material)) == parallel.count_of(MaterialId(material)));
+}
+
+int main() {
+    // The chunks of a phase can be updated in any order on any thread,
+    // so every mode must end in the same state.
+    for(const Scenario& scenario: get_scenarios()) {
+        if(!scenario.setup)
+            continue;
+
+        const GridState serial = run(scenario, UpdateMode::SERIAL);
+        CHECK(serial == run(scenario, UpdateMode::PARALLEL));
+        CHECK(serial == run(scenario, UpdateMode::VERIFY));
+    }
+
+    for(const Scenario& scenario: get_scenarios()) {
+        if(scenario.name == "sparse_islands")
+            check_sparse_modes(scenario.sparse_setup, get_island_regions());
+    }
+    check_sparse_modes(set_up_staircase, {{-CHUNK_SIZE, 0, 41 * CHUNK_SIZE, 2100}});
+    return test_result();
+}